@@ -9,6 +9,30 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdalign.h>
+#include <setjmp.h>
+
+// mmap is used for huge page backing where the platform has it
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define REMEM_HAVE_MMAP 1
+#else
+#define REMEM_HAVE_MMAP 0
+#endif
+
+// vector filters for scanned words, AVX2 is only used if the CPU running the GC has it (NEON is always there on aarch64)
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define REMEM_HAVE_AVX2 1
+#else
+#define REMEM_HAVE_AVX2 0
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define REMEM_HAVE_NEON 1
+#else
+#define REMEM_HAVE_NEON 0
+#endif
 
 // -=*##############*=-
 //    PRIVATE THINGS
@@ -26,6 +50,7 @@ static const size_t sizeClasses[] = {
 };
 #define NUM_CLASSES \
     (sizeof(sizeClasses) / sizeof(sizeClasses[0]))
+static_assert(NUM_CLASSES == GC_NUM_CLASSES, "GC_NUM_CLASSES must match sizeClasses");
 
 // align helpers
 #define ALIGN_DOWN(x,a) \
@@ -33,41 +58,239 @@ static const size_t sizeClasses[] = {
 #define ALIGN_UP(x,a) \
     (((uintptr_t)(x) + ((uintptr_t)(a) - 1)) & ~((uintptr_t)(a) - 1))
 
+// prefetch helper, a no-op where the compiler has no prefetch builtin
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(p) \
+    __builtin_prefetch((p), 0, 3)
+#else
+#define PREFETCH(p) \
+    ((void)(p))
+#endif
+
+// objects taken off the worklist are prefetched and traced this many objects later
+#define PREFETCH_DEPTH 8
+
+// bytes past a stack checkpoint's frame hint that are always left to the live scan (the frame calling gcStackCheckpoint() is never snapshotted)
+#define CHECKPOINT_FRAME_SLACK 4096
+
+// huge page helpers
+#define HUGE_PAGE_SIZE \
+    ((size_t)2 * 1024 * 1024)
+// chunks page blocks are carved from when using huge pages (BUFF_SIZE is a power of two so one always divides the other)
+#define HUGE_CHUNK_SIZE \
+    ((size_t)BUFF_SIZE > HUGE_PAGE_SIZE ? (size_t)BUFF_SIZE : HUGE_PAGE_SIZE)
+
+// large classes use spans of several contiguous BUFF_SIZE units so their pages hold around SPAN_MIN_SLOTS slots (up to SPAN_MAX_UNITS units)
+#define SPAN_MIN_SLOTS 32
+#define SPAN_MAX_UNITS 8
+
+// where a page's block came from, decides how it is given back
+typedef enum BlockSource{
+    BLOCK_ARENA,    // arenaLocalAllocBuffsizeBlock(), stays until the arena is destroyed
+    BLOCK_HEAP,     // aligned_alloc(), given back with free()
+    BLOCK_HUGE,     // carved from a huge page chunk, decommitted and reused
+    BLOCK_MAPPED    // mapped on its own with huge pages hinted, unmapped
+} BlockSource;
+
+// most slots a page can have (the smallest class is 16 bytes)
+#define PAGE_MAX_SLOTS \
+    ((size_t)BUFF_SIZE / 16)
+// number of 64 bit words needed for a full page bitmap
+#define PAGE_BITMAP_WORDS \
+    ((PAGE_MAX_SLOTS + 63) / 64)
+
+// smallest slot size whose dead slots have their OS pages decommitted by sweeps (when freeMemory is true)
+#define DECOMMIT_MIN_SIZE \
+    ((size_t)16384)
+// number of 64 bit words needed to track decommitted slots of those classes (spans hold fewer than 2 * SPAN_MIN_SLOTS slots)
+#define DECOMMIT_MAX_SLOTS \
+    ((size_t)BUFF_SIZE / DECOMMIT_MIN_SIZE > 2 * SPAN_MIN_SLOTS ? (size_t)BUFF_SIZE / DECOMMIT_MIN_SIZE : 2 * SPAN_MIN_SLOTS)
+#define DECOMMIT_BITMAP_WORDS \
+    ((DECOMMIT_MAX_SLOTS + 63) / 64)
+
+// Immix engine pages are split into lines that are marked and reused whole, objects are rounded up to granules
+#define IMMIX_LINE_SIZE 128
+#define IMMIX_GRANULE 16
+// number of 64 bit words needed for a page's line bitmap
+#define IMMIX_LINE_WORDS \
+    (((size_t)BUFF_SIZE / IMMIX_LINE_SIZE + 63) / 64)
+// largest object the Immix engine bump allocates, bigger ones use size classes
+#define IMMIX_MAX_OBJECT \
+    ((size_t)BUFF_SIZE / 4)
+
+// what a page is laid out for, decides how its bits are read
+typedef enum PageKind{
+    PAGE_CLASS, // equal slots of one size class
+    PAGE_IMMIX, // granules bump allocated by the Immix engine, inuseBits hold each object's first granule
+    PAGE_REGION,    // bump allocated by a region and released when it ends, has no slots so it is never marked or swept
+    PAGE_PERMANENT, // bump allocated by gcAllocPermanent() and kept until gcDestroy(), never marked or swept either
+    PAGE_MOVABLE    // size class slots only handed out through handles (gcAllocMovable()), unpinned objects can be evacuated
+} PageKind;
+
+// movable pages at most 1/EVACUATE_DIVISOR full after a sweep have their unpinned objects moved to denser pages
+#define EVACUATE_DIVISOR 4
+
 // Pages that the GC uses to store memory acts as a linked list
 // pages are split into blocks that the GC manages
+// Page records live in slabs (see Page Slabs) with their bitmaps inline so making or resetting one never calls malloc
 typedef struct Page{
     // pointer to arena buffer
     void *block;
+    void *slots;        // start of the slot array (block shifted by the page's cache color)
+    size_t spanSize;    // bytes in block, a whole number of BUFF_SIZE units
+    uint8_t blockSource;// where block came from (see BlockSource)
+    uint8_t kind;       // what the page is laid out for (see PageKind)
+    uint8_t evacuating; // movable page being emptied by the current collection
+    uint8_t reserved;   // class page made by gcReserve(), stays on its class list (and formatted for it) when a sweep leaves it empty
 
     // pages info
     size_t sizeClass;   // slot size (bytes) for this page
     uint32_t nslots;    // how many slots fit into block
     uint32_t inuseCount;// number of currently allocated slots
-    int32_t freeHead;   // index of first free slot (-1 if none)
-
-    // bit arrays to mark for gc collection
-    uint8_t *inuseBits;
-    uint8_t *markBits;  // if reachable by stack pointer
+    uint32_t allocCursor;// first bitmap word that may have a free slot (every word before it is full), first line to look for free lines from on Immix pages, bytes handed out on region pages
+    uint32_t markEpoch; // collection the mark bits were last brought up to date for (see pageSyncEpoch())
+    uint32_t blackCount;// free slots (Immix lines) blacklisted by collection blackEpoch, blackBits (blackLines on Immix pages) is only valid while this is non zero
+    uint32_t blackEpoch;// collection that blacklisted them, the blacklist is dropped once the next one starts (see pageBlackCount())
 
     struct Page *nextPage;
+
+    // bit arrays to mark for gc collection (only the first nslots bits are used)
+    uint64_t inuseBits[PAGE_BITMAP_WORDS];
+    uint64_t markBits[PAGE_BITMAP_WORDS];   // if reachable by stack pointer (meaning flips every collection, see markedBits())
+    uint64_t decommitBits[DECOMMIT_BITMAP_WORDS];   // free slots whose OS pages were given back (they read as zeros), only for classes >= DECOMMIT_MIN_SIZE
+
+    union{
+        uint64_t endBits[PAGE_BITMAP_WORDS];    // Immix pages, last granule of every allocated object
+        uint64_t pinBits[PAGE_BITMAP_WORDS];    // movable pages, slots the current collection found a raw pointer to (or pinned by gcPin()) that cannot move
+        uint64_t blackBits[PAGE_BITMAP_WORDS];  // class and pool pages, free slots a scanned word pointed into (blacklisted so allocation avoids them)
+    };
+    uint64_t lineBits[IMMIX_LINE_WORDS];    // Immix pages, lines holding part of an object marked by the last collection
+    uint64_t blackLines[IMMIX_LINE_WORDS];  // Immix pages, free lines a scanned word pointed into (kept apart from lineBits so they never count as live)
 } Page;
 
+// Slab of contiguous Page records so page metadata is not scattered across the malloc heap
+#define PAGES_PER_SLAB 16
+typedef struct PageSlab{
+    struct PageSlab *nextSlab;
+    Page pages[PAGES_PER_SLAB];
+} PageSlab;
+
+// Pool of exact size slots made by gcPoolCreate() (GCPool in ReMem.h)
+// its pages are formatted like class pages but with the pool's slot size
+struct GCPool{
+    size_t slotSize;    // object size rounded up to the pool's alignment
+    size_t align;
+
+    Page *pages;
+    Page *cursor;   // first page that may have a free slot (every page before it is full)
+
+    struct GCPool *nextPool;
+};
+
+// Region made by gcRegionBegin() (GCRegion in ReMem.h)
+// objects are bump allocated onto its own pages which are scanned as roots while it is open and released together by gcRegionEnd()
+struct GCRegion{
+    Page *pages;        // newest page first, it is the one being bump allocated into
+    uintptr_t cursor;   // next free byte on the newest page
+    uintptr_t limit;    // end of the newest page
+
+    struct GCRegion *nextRegion;
+};
+
+// Stack registered with gcRegisterStack() (GCStack in ReMem.h), the main stack has one of its own in gc.mainStack
+// while suspended everything between sp and the stack's base is scanned along with the registers it was suspended with
+struct GCStack{
+    uintptr_t low;      // bounds of the stack (both 0 for the main stack, it ends at stack_top_hint)
+    uintptr_t high;
+    uintptr_t sp;       // where the stack was when gcSwitchStack() suspended it (0 if it never ran)
+    jmp_buf regs;       // registers captured by gcSwitchStack() when it was suspended
+
+    // saved register context of the fiber (ucontext_t, jmp_buf...) given to gcRegisterStack()
+    const void *ctx;
+    size_t ctxLen;
+
+    struct GCStack *nextStack;
+};
+
 // Book is used to store a list of linked lists of pages
 // also stores chache of emptyPages when freeMemory is not true along with a total number of pages managed
 typedef struct Book{
     // Pages
-    Page *classPages[NUM_CLASSES];  // list of pointera for each class size
+    Page *classPages[NUM_CLASSES];  // list of pointera for each class size (fullest first after every sweep)
+    Page *classCursor[NUM_CLASSES]; // first page in each class list that may have a free slot (every page before it is full)
     Page *emptyPages;
 
+    // pools made by gcPoolCreate()
+    GCPool *pools;
+
+    // pages of objects allocated by gcAllocMovable() for each class size
+    Page *movablePages[NUM_CLASSES];
+    Page *movableCursor[NUM_CLASSES];
+
+    // regions opened by gcRegionBegin() that have not ended
+    GCRegion *regions;
+
+    // permanent space filled by gcAllocPermanent(), a region that never ends
+    GCRegion permanent;
+
+    // Immix engine pages
+    Page *immixPages;
+    Page *immixCursor;  // next page to look for free lines on (pages before it have none left until the next sweep)
+
     int numPages;
 } Book;
 
+// slot arrays are shifted by a whole number of cache lines per page so equal index slots on different pages use different cache sets
+#define COLOR_LINE 64
+#define COLOR_COUNT 64
+// largest class that gets colored (bigger classes would lose too large a share of their few slots)
+#define COLOR_MAX_CLASS \
+    ((size_t)4096)
+
+// alignment size class slots are guaranteed (pools can ask for more)
+#define CLASS_ALIGN \
+    (alignof(max_align_t))
+
+// number of occupancy buckets class lists are sorted into after a sweep
+#define OCCUPANCY_BUCKETS 8
+
 // Workitem stores a page and index within that page for the GC
 typedef struct WorkItem{
     Page *page;
     uint32_t idx;
 } WorkItem;
 
+// the mark stack is built from chunks of MARK_CHUNK_ITEMS work items, MARK_CHUNKS_RESERVED of them are made on init
+#define MARK_CHUNK_ITEMS 1024
+#define MARK_CHUNKS_RESERVED 8
+
+// Chunk of the mark stack, chunks are linked into a stack while in use and into the free pool otherwise
+typedef struct MarkChunk{
+    struct MarkChunk *prev;     // chunk under this one (next free chunk while pooled)
+    size_t len;
+    WorkItem items[MARK_CHUNK_ITEMS];
+} MarkChunk;
+
+// Entry of the handle table behind gc_handle_t, handle h is entry h (entry 0 is never used so 0 can mean no handle)
+typedef struct HandleEntry{
+    void *ptr;          // current address of the object, NULL if the entry is free
+    uint32_t pins;      // gcPin() calls without a matching gcUnpin()
+    uint32_t nextFree;  // next free entry when this one is free
+} HandleEntry;
+
+// Run of free lines the Immix engine is bump allocating into
+typedef struct BumpRegion{
+    Page *page;
+    uintptr_t cursor;   // next free byte
+    uintptr_t limit;    // end of the run
+} BumpRegion;
+
+// Block of memory registered with gcAddRootRange() that is conservatively scanned as a root
+typedef struct RootRange{
+    uintptr_t low;
+    uintptr_t high;
+} RootRange;
+
 // Main GC object
 // - stores a book for pages of memory
 // - stores a pointer to the Underlying Arena used for memory
@@ -80,27 +303,99 @@ typedef struct GC{
     // whether to keep all normal objects in the arena or ot use aligned_alloc and free
     bool freeMemory;
 
+    // whether page blocks are carved from huge page backed chunks
+    bool hugePages;
+
+    // whether permanent pages may be changed to point at GC objects and so have to be scanned every collection
+    bool permanentMutable;
+
+    // whether collections conservatively scan the stack between the current frame and stack_top_hint
+    bool stackScan;
+
+    // fiber and coroutine stacks registered with gcRegisterStack(), currentStack is the one running (NULL for the main stack)
+    GCStack mainStack;
+    GCStack *stacks;
+    GCStack *currentStack;
+    bool stackGrowsDown;
+
+    // reports the embedder's precise roots every collection (see gcSetRootCallback())
+    GCRootCallback rootCallback;
+    void *rootCallbackCtx;
+    bool inRootCallback;    // gcMarkRoot() and gcMarkRootRange() only mark while this is set
+
+    // number of pages reserved by gcReserve() that are kept even when freeMemory is true
+    size_t reservedPages;
+
+    // allocation engine used by gcAlloc()
+    GCEngine engine;
+
+    // Immix bump regions, medium objects that do not fit the current run go to the overflow region
+    BumpRegion immixBump;
+    BumpRegion immixOverflow;
+
     // shunting arena
     Arena *arena;
 
     // book of pages
     Book book;
     
+    // handle table for movable objects
+    HandleEntry *handles;
+    size_t handlesLen;
+    size_t handlesCap;
+    uint32_t handleFree;    // first free entry (0 if none)
+
     // roots marked as in use
     void ***roots;
     size_t rootsLen;
     size_t rootsCap;
 
+    // open addressing index into roots (key = root address)
+    uint32_t *rootIndex;
+    size_t rootIndexCap;    // power of two
+
+    // stack checkpoint set by gcStackCheckpoint() (0 if none), frames older than it are not rescanned
+    // checkpointWords holds the words of those frames that pointed into GC pages when it was taken
+    uintptr_t stackCheckpoint;
+    uintptr_t *checkpointWords;
+    size_t checkpointLen;
+    size_t checkpointCap;
+#ifndef NDEBUG
+    // debug builds keep a copy of every word of the checkpointed frames to catch them being changed to point at GC objects
+    uintptr_t *checkpointCopy;
+    size_t checkpointCopyLen;
+#endif
+
+    // blocks of memory scanned as roots a word at a time
+    RootRange *rootRanges;
+    size_t rootRangesLen;
+    size_t rootRangesCap;
+
+    // counts collections, a mark bit equal to the low bit of the current epoch means marked
+    uint32_t markEpoch;
+
+    // next cache color handed to a formatted page
+    uint32_t nextColor;
+
+    // bytes of free slots currently decommitted by sweeps
+    size_t decommittedBytes;
+
+    // free slots and Immix lines the last collection blacklisted because a scanned word pointed into them
+    size_t blacklisted;
+
     // GC pressure stats
     size_t bytesSinceLastGC;
     size_t lastLiveBytes;
     double growthFactor;
 } GC;
 
-// dynamic array for worklist items
-static WorkItem *worklist = NULL;
-static size_t workLen = 0;
-static size_t workCap = 0;
+// mark stack of fixed size chunks taken from a pool made outside of marking, marking itself never allocates
+// when the pool runs dry items are dropped and markOverflow is set so the marked objects get rescanned
+static MarkChunk *markTop = NULL;   // chunk being pushed to and popped from
+static MarkChunk *markPool = NULL;  // free chunks
+static size_t markChunks = 0;       // chunks made so far
+static bool markOverflow = false;
+static bool markOverflowed = false; // whether the current collection overflowed at all
 
 // open addressing hash map (key = *page->block)
 static uintptr_t *pageIndexKeys = NULL; // 0 means empty slot
@@ -108,9 +403,37 @@ static Page **pageIndexVals = NULL;
 static size_t pageIndexCap  = 0;    // power of two
 static size_t pageIndexCnt  = 0;
 
+// bounds of every block put in the page index so far (both 0 before the first), scanned words outside of them skip the lookup
+static uintptr_t heapLow = 0;
+static uintptr_t heapHigh = 0;
+
+// slabs Page records are handed out from
+static PageSlab *pageSlabs = NULL;
+static Page *pageFreeRecords = NULL;    // unused records linked by nextPage
+static size_t pageFreeCount = 0;
+
+// huge page chunks that page blocks are carved from (only used when gc.hugePages)
+static void **hugeChunks = NULL;
+static size_t hugeChunksLen = 0;
+static size_t hugeChunksCap = 0;
+static uintptr_t hugeCursor = 0;    // next uncarved block in the newest chunk
+static uintptr_t hugeLimit = 0;     // end of the newest chunk
+static bool hugeTlbFailed = false;  // stop asking for MAP_HUGETLB once it fails
+
+// size of the OS's pages (used to prefault one byte per page)
+static size_t osPageSize = 4096;
+
+// decommitted page blocks waiting to be reused (only used when gc.hugePages)
+static void **hugeFreeBlocks = NULL;
+static size_t hugeFreeLen = 0;
+static size_t hugeFreeCap = 0;
+
 // global reference to gc (maybe add multiple as an array of gc's later)
 static GC gc;
 
+// shadow stack the GC_FRAME macros in ReMem.h push function scoped roots onto
+GCShadowStack gcShadowStack = {NULL, 0, 0};
+
 // ====================
 // Hash Table & Helpers
 // ====================
@@ -155,19 +478,20 @@ static void pageIndexFree(){
     pageIndexVals = NULL;
 
     pageIndexCap = pageIndexCnt = 0;
+    heapLow = heapHigh = 0;
 }
 
-// Grows page indexes
-// minimum of 128, doubles every time more are needed
+// Grows page indexes to at least newCap
+// minimum of 128, callers double every time more are needed
 // moves all old hashes into new one
-static void pageIndexGrow(){
+static void pageIndexGrow(size_t newCap){
     // save all current values in temp variables
     size_t oldCap = pageIndexCap;
     uintptr_t *oldKeys = pageIndexKeys;
     Page **oldVals = pageIndexVals;
 
-    // grow by factor of 2
-    pageIndexInit(oldCap ? oldCap * 2 : 128);
+    // grow to the new capacity
+    pageIndexInit(newCap > 128 ? newCap : 128);
 
     // reinsert all old values into new expanded hash
     for(size_t i = 0; i < oldCap; i++){
@@ -193,16 +517,13 @@ static void pageIndexGrow(){
     free(oldVals);
 }
 
-// Inserts a page into the hash
-static void pageIndexInsert(Page *page){
-    // get pointer to base of page block
-    uintptr_t base = (uintptr_t)page->block;
-
+// Inserts one BUFF_SIZE unit of a page into the hash
+static void pageIndexInsertUnit(uintptr_t base, Page *page){
     if(pageIndexCap == 0) \
         pageIndexInit(128);
 
     if((pageIndexCnt + 1) * 10 >= pageIndexCap * 7){
-        pageIndexGrow();
+        pageIndexGrow(pageIndexCap * 2);
     }
 
     // get position from pointer and mask
@@ -221,7 +542,36 @@ static void pageIndexInsert(Page *page){
     pageIndexVals[pos] = page;
 }
 
-// removes a page from the hashes and moves other pages based on new free indexes
+// Inserts a page into the hash, every BUFF_SIZE unit of its span maps to the page
+// the heap bounds only ever grow so they still cover blocks that were since given back
+static void pageIndexInsert(Page *page){
+    for(size_t off = 0; off < page->spanSize; off += BUFF_SIZE){
+        pageIndexInsertUnit((uintptr_t)page->block + off, page);
+    }
+
+    uintptr_t low = (uintptr_t)page->block;
+    uintptr_t high = low + page->spanSize;
+    if(heapHigh == 0 || low < heapLow) \
+        heapLow = low;
+    if(high > heapHigh) \
+        heapHigh = high;
+}
+
+// Grows the page index once so `extra` more pages can be inserted without rehashing
+static void pageIndexReserve(size_t extra){
+    size_t want = pageIndexCnt + extra + 1;
+    if(want * 10 < pageIndexCap * 7) \
+        return;
+
+    // smallest power of two that keeps the load under 70%
+    size_t cap = pageIndexCap ? pageIndexCap : 128;
+    while(want * 10 >= cap * 7) \
+        cap <<= 1;
+
+    pageIndexGrow(cap);
+}
+
+// removes one BUFF_SIZE unit of a page from the hashes and moves other pages based on new free indexes
 static void pageIndexRemove(void *basePtr){
     if(pageIndexCap == 0) \
         return;
@@ -262,7 +612,6 @@ static void pageIndexRemove(void *basePtr){
                 // get next page
                 next = (next + 1) & mask;
             }
-            gc.book.numPages--;
 
             return; // exit finishing successfully
         }
@@ -303,14 +652,127 @@ static Page *pageIndexFindByAddr(void *p){
 // Bit Helpers
 // ===========
 
-// Shifts a bit into a byte
-static inline size_t bitByte(size_t i){
-    return i >> 3;
+// Returns the index of the word holding a bit
+static inline size_t bitWord(size_t i){
+    return i >> 6;
+}
+
+// Returns the bitmask of a bit within its word
+static inline uint64_t bitMask(size_t i){
+    return (uint64_t)1 << (i & 63);
+}
+
+// Returns the number of words used by a bitmap of nbits bits
+static inline size_t bitWords(size_t nbits){
+    return (nbits + 63) >> 6;
 }
 
-// Returns the bitmask of a given byte
-static inline uint8_t bitMask(size_t i){
-    return (uint8_t)(1u << (i & 7));
+// Returns the number of set bits in a word
+static inline uint32_t bitPopcount(uint64_t x){
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_popcountll(x);
+#else
+    uint32_t n = 0;
+    for(; x; x &= x - 1) \
+        n++;
+
+    return n;
+#endif
+}
+
+// Returns the index of the lowest set bit in a non zero word
+static inline uint32_t bitLowest(uint64_t x){
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_ctzll(x);
+#else
+    uint32_t n = 0;
+    while(!(x & 1)){
+        x >>= 1;
+        n++;
+    }
+
+    return n;
+#endif
+}
+
+// Returns the index of the highest set bit in a non zero word
+static inline uint32_t bitHighest(uint64_t x){
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - (uint32_t)__builtin_clzll(x);
+#else
+    uint32_t n = 63;
+    while(!(x >> 63)){
+        x <<= 1;
+        n--;
+    }
+
+    return n;
+#endif
+}
+
+// Returns the mask of bits in word w that belong to one of nbits bits
+static inline uint64_t bitWordMask(size_t nbits, size_t w){
+    size_t rem = nbits - w * 64;
+
+    return rem >= 64 ? ~(uint64_t)0 : (bitMask(rem) - 1);
+}
+
+// Returns the index of the first bit at or after `from` equal to `value`, or nbits if there is none
+static inline size_t bitNext(const uint64_t *bits, size_t nbits, size_t from, bool value){
+    if(from >= nbits) \
+        return nbits;
+
+    uint64_t flip = value ? 0 : ~(uint64_t)0;
+    size_t w = bitWord(from);
+    uint64_t word = (bits[w] ^ flip) & ~(bitMask(from) - 1) & bitWordMask(nbits, w);
+    while(word == 0){
+        if(++w >= bitWords(nbits)) \
+            return nbits;
+        word = (bits[w] ^ flip) & bitWordMask(nbits, w);
+    }
+
+    return w * 64 + bitLowest(word);
+}
+
+// Returns the index of the last set bit at or before `from`, looking no lower than the word holding `floor`
+// returns SIZE_MAX if there is none
+static inline size_t bitPrevSet(const uint64_t *bits, size_t from, size_t floor){
+    size_t w = bitWord(from);
+    uint64_t word = bits[w] & (bitMask(from) | (bitMask(from) - 1));
+    while(word == 0){
+        if(w == 0 || w <= bitWord(floor)) \
+            return SIZE_MAX;
+        word = bits[--w];
+    }
+
+    return w * 64 + bitHighest(word);
+}
+
+// ==========
+// Mark Epoch
+// ==========
+
+// Returns a mark word with a bit set for every slot that counts as marked in the current epoch
+// the meaning of a mark bit flips every collection so survivors never have their marks cleared
+static inline uint64_t markedBits(uint64_t markWord){
+    return (gc.markEpoch & 1) ? markWord : ~markWord;
+}
+
+// Brings a page's mark bits in line with the collection about to mark it (gc.markEpoch)
+// before marking every allocated slot has to read as unmarked, which means holding the low bit of the previous epoch
+// pages stamped with an epoch of the other parity (ones that missed sweeps) get their allocated bits flipped once
+static inline void pageSyncEpoch(Page *page){
+    uint32_t prev = gc.markEpoch - 1;
+    if(page->markEpoch == prev) \
+        return;
+
+    if((page->markEpoch ^ prev) & 1){
+        size_t nwords = bitWords(page->nslots);
+        for(size_t w = 0; w < nwords; w++){
+            page->markBits[w] ^= page->inuseBits[w];
+        }
+    }
+    page->markEpoch = prev;
 }
 
 // ==============
@@ -319,12 +781,296 @@ static inline uint8_t bitMask(size_t i){
 
 // Returns a pointer to the base of the slot in given page at the given index
 static inline void *slotBase(Page *page, uint32_t idx){
-    return (void *)((uintptr_t)page->block + (uintptr_t)idx * page->sizeClass);
+    return (void *)((uintptr_t)page->slots + (uintptr_t)idx * page->sizeClass);
+}
+
+
+// ===============
+// OS Page Backing
+// ===============
+
+// Maps `size` bytes aligned to `align` straight from the OS
+// over maps by `align` and trims the ends so the result is aligned
+// returns NULL if the memory could not be mapped
+static void *osMapAligned(size_t size, size_t align){
+#if REMEM_HAVE_MMAP
+    size_t span = size + align;
+    void *raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED) \
+        return NULL;
+
+    // trim the unaligned head and the leftover tail
+    uintptr_t start = ALIGN_UP(raw, align);
+    size_t head = start - (uintptr_t)raw;
+    size_t tail = span - head - size;
+    if(head) \
+        munmap(raw, head);
+    if(tail) \
+        munmap((void *)(start + size), tail);
+
+    return (void *)start;
+#else
+    (void)size; (void)align;
+
+    return NULL;
+#endif
+}
+
+// Returns memory from osMapAligned() or hugeChunkMap() back to the OS
+static void osUnmap(void *p, size_t size){
+#if REMEM_HAVE_MMAP
+    munmap(p, size);
+#else
+    (void)p; (void)size;
+#endif
+}
+
+// Tells the OS it can drop the physical memory behind [p, p+size) while keeping the addresses reserved
+// the next touch of that memory gets fresh zeroed pages
+// on huge page backed memory the kernel splits any huge page the range only partially covers
+// returns whether the memory was actually released
+static bool osDecommit(void *p, size_t size){
+#if REMEM_HAVE_MMAP && defined(MADV_DONTNEED)
+    return madvise(p, size, MADV_DONTNEED) == 0;
+#else
+    (void)p; (void)size;
+
+    return false;
+#endif
+}
+
+// Faults in [p, p+size) now so the first real use of the memory does not page fault
+// uses madvise(MADV_POPULATE_WRITE) where available otherwise touches a byte on every OS page
+static void osPrefault(void *p, size_t size){
+#if REMEM_HAVE_MMAP && defined(MADV_POPULATE_WRITE)
+    if(madvise(p, size, MADV_POPULATE_WRITE) == 0) \
+        return;
+#endif
+
+    // write every page back with its own value so it is committed without changing anything
+    for(uintptr_t b = (uintptr_t)p; b < (uintptr_t)p + size; b += osPageSize){
+        volatile uint8_t *byte = (volatile uint8_t *)b;
+        *byte = *byte;
+    }
+}
+
+// Maps a new HUGE_CHUNK_SIZE chunk backed by huge pages where possible
+// tries MAP_HUGETLB first (only when a page block is whole huge pages so decommits stay huge page aligned)
+// then falls back to a 2MB aligned mapping with madvise(MADV_HUGEPAGE) which the kernel may or may not honor
+static void *hugeChunkMap(){
+#if REMEM_HAVE_MMAP && defined(MAP_HUGETLB)
+    if(!hugeTlbFailed && (BUFF_SIZE % HUGE_PAGE_SIZE) == 0){
+        void *chunk = mmap(NULL, HUGE_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(chunk != MAP_FAILED && (((uintptr_t)chunk) & (HUGE_CHUNK_SIZE - 1)) == 0) \
+            return chunk;
+        if(chunk != MAP_FAILED) \
+            munmap(chunk, HUGE_CHUNK_SIZE);
+
+        hugeTlbFailed = true;   // no reserved huge pages (or bad alignment) so stick to transparent huge pages
+    }
+#endif
+
+    void *chunk = osMapAligned(HUGE_CHUNK_SIZE, HUGE_CHUNK_SIZE);
+#if REMEM_HAVE_MMAP && defined(MADV_HUGEPAGE)
+    if(chunk != NULL) \
+        madvise(chunk, HUGE_CHUNK_SIZE, MADV_HUGEPAGE);    // only a hint, failure just means regular pages
+#endif
+
+    return chunk;
+}
+
+// Returns a BUFF_SIZE aligned page block carved from a huge page chunk
+// reuses decommitted blocks before carving new ones
+// returns NULL if no memory could be mapped
+static void *hugeBlockAlloc(){
+    // reuse a released block
+    if(hugeFreeLen) \
+        return hugeFreeBlocks[--hugeFreeLen];
+
+    // map a new chunk once the newest one is used up
+    if(hugeCursor >= hugeLimit){
+        // make room to remember the chunk for gcDestroy()
+        if(hugeChunksLen == hugeChunksCap){
+            size_t newCap = hugeChunksCap ? hugeChunksCap * 2 : 16;
+            void **temp = realloc(hugeChunks, newCap * sizeof(void *));
+            if(temp == NULL) \
+                return NULL;
+
+            hugeChunks = temp;
+            hugeChunksCap = newCap;
+        }
+
+        void *chunk = hugeChunkMap();
+        if(chunk == NULL) \
+            return NULL;
+
+        hugeChunks[hugeChunksLen++] = chunk;
+        hugeCursor = (uintptr_t)chunk;
+        hugeLimit = hugeCursor + HUGE_CHUNK_SIZE;
+    }
+
+    // carve the next block
+    void *block = (void *)hugeCursor;
+    hugeCursor += BUFF_SIZE;
+
+    return block;
+}
+
+// Gives a huge page backed block's physical memory back to the OS and keeps its address for reuse
+static void hugeBlockRelease(void *block){
+    osDecommit(block, BUFF_SIZE);
+
+    // remember the block for reuse (if there is no room it is simply left decommitted until gcDestroy())
+    if(hugeFreeLen == hugeFreeCap){
+        size_t newCap = hugeFreeCap ? hugeFreeCap * 2 : 64;
+        void **temp = realloc(hugeFreeBlocks, newCap * sizeof(void *));
+        if(temp == NULL) \
+            return;
+
+        hugeFreeBlocks = temp;
+        hugeFreeCap = newCap;
+    }
+    hugeFreeBlocks[hugeFreeLen++] = block;
+}
+
+// Maps a span of several BUFF_SIZE units on its own with huge pages hinted
+// spans do not fit the fixed size chunks so they are unmapped when released instead of reused
+static void *hugeSpanMap(size_t span){
+    size_t align = (size_t)BUFF_SIZE > HUGE_PAGE_SIZE ? (size_t)BUFF_SIZE : HUGE_PAGE_SIZE;
+    void *block = osMapAligned(span, align);
+#if REMEM_HAVE_MMAP && defined(MADV_HUGEPAGE)
+    if(block != NULL) \
+        madvise(block, span, MADV_HUGEPAGE);
+#endif
+
+    return block;
+}
+
+// Unmaps every huge page chunk and forgets all blocks carved from them
+static void hugeChunksDestroy(){
+    for(size_t i = 0; i < hugeChunksLen; i++){
+        osUnmap(hugeChunks[i], HUGE_CHUNK_SIZE);
+    }
+    free(hugeChunks);
+    hugeChunks = NULL;
+    hugeChunksLen = hugeChunksCap = 0;
+    hugeCursor = hugeLimit = 0;
+
+    free(hugeFreeBlocks);
+    hugeFreeBlocks = NULL;
+    hugeFreeLen = hugeFreeCap = 0;
+}
+
+// ==========
+// Page Slabs
+// ==========
+
+// Allocates a new slab and adds its records to the free list in address order
+// returns false if the slab could not be allocated
+static bool pageSlabGrow(){
+    PageSlab *slab = malloc(sizeof(PageSlab));
+    if(slab == NULL) \
+        return false;
+
+    slab->nextSlab = pageSlabs;
+    pageSlabs = slab;
+
+    // push in reverse so records are handed out lowest address first
+    for(size_t i = PAGES_PER_SLAB; i > 0; i--){
+        slab->pages[i - 1].nextPage = pageFreeRecords;
+        pageFreeRecords = &slab->pages[i - 1];
+    }
+    pageFreeCount += PAGES_PER_SLAB;
+
+    return true;
+}
+
+// Makes sure at least `count` Page records are free so that many pages can be made without growing slabs
+static bool pageSlabReserve(size_t count){
+    while(pageFreeCount < count){
+        if(!pageSlabGrow()) \
+            return false;
+    }
+
+    return true;
+}
+
+// Returns an unused Page record (contents undefined) or NULL if no slab could be allocated
+static Page *pageSlabAlloc(){
+    if(pageFreeRecords == NULL && !pageSlabGrow()) \
+        return NULL;
+
+    Page *page = pageFreeRecords;
+    pageFreeRecords = page->nextPage;
+    pageFreeCount--;
+
+    return page;
+}
+
+// Returns a Page record to its slab's free list
+static void pageSlabFree(Page *page){
+    page->nextPage = pageFreeRecords;
+    pageFreeRecords = page;
+    pageFreeCount++;
+}
+
+// Frees every slab and forgets all records handed out from them
+static void pageSlabsDestroy(){
+    while(pageSlabs){
+        PageSlab *next = pageSlabs->nextSlab;
+        free(pageSlabs);
+        pageSlabs = next;
+    }
+    pageFreeRecords = NULL;
+    pageFreeCount = 0;
+}
+
+// =============
+// Slot Decommit
+// =============
+
+// Returns the length of the OS pages lying wholly inside a slot and stores where they start in *lo
+static inline size_t slotInnerPages(Page *page, uint32_t idx, uintptr_t *lo){
+    uintptr_t start = (uintptr_t)slotBase(page, idx);
+    uintptr_t first = ALIGN_UP(start, osPageSize);
+    uintptr_t last = ALIGN_DOWN(start + page->sizeClass, osPageSize);
+
+    *lo = first;
+
+    return last > first ? (size_t)(last - first) : 0;
+}
+
+// Gives the OS pages inside a dead slot back to the OS and records that the slot now reads as zeros
+static void slotDecommit(Page *page, uint32_t idx){
+    uintptr_t lo;
+    size_t len = slotInnerPages(page, idx, &lo);
+
+    // osDecommit() fails on hugetlb pages smaller than a huge page so only record real decommits
+    if(len && osDecommit((void *)lo, len)){
+        page->decommitBits[bitWord(idx)] |= bitMask(idx);
+        gc.decommittedBytes += len;
+    }
+}
+
+// Forgets the decommitted state of a slot that is being handed out again
+static inline void slotRecommit(Page *page, uint32_t idx){
+    if(page->decommitBits[bitWord(idx)] & bitMask(idx)){
+        uintptr_t lo;
+        page->decommitBits[bitWord(idx)] &= ~bitMask(idx);
+        gc.decommittedBytes -= slotInnerPages(page, idx, &lo);
+    }
 }
 
-// Returns a pointer to a slot based off of the given page and index
-static inline int32_t *slotNextPtr(Page *page, uint32_t idx){
-    return (int32_t *)slotBase(page, idx);
+// Forgets every decommitted slot on a page that is being reset or destroyed
+static void pageForgetDecommits(Page *page){
+    if(page->sizeClass < DECOMMIT_MIN_SIZE) \
+        return;
+
+    for(size_t w = 0; w < DECOMMIT_BITMAP_WORDS; w++){
+        while(page->decommitBits[w]){
+            slotRecommit(page, (uint32_t)(w * 64 + bitLowest(page->decommitBits[w])));
+        }
+    }
 }
 
 // ================
@@ -344,10 +1090,86 @@ static int classForSize(size_t size){
     return -1;
 }
 
-// Initializes a page for a given class size and returns a pointer to said page
-// allocates BUFF_SIZE block of memory needed and breaks it up into sizeClass slots
-static Page *pageInitForClass(int classIndex){
-    Page *page = malloc(sizeof(Page));
+// Returns how many BUFF_SIZE units a page of slotSize slots spans
+static inline size_t slotSpanUnits(size_t slotSize){
+    size_t units = (SPAN_MIN_SLOTS * slotSize + BUFF_SIZE - 1) / BUFF_SIZE;
+
+    return units > SPAN_MAX_UNITS ? SPAN_MAX_UNITS : units;
+}
+
+// Returns how many BUFF_SIZE units a page of the given class spans
+static inline size_t classSpanUnits(int classIndex){
+    return slotSpanUnits(sizeClasses[classIndex]);
+}
+
+// Allocates a BUFF_SIZE aligned block of `span` bytes from huge pages, arena or regular memory pool based on settings
+// stores where it came from in *source so pageBlockRelease() knows how to give it back
+// the arena only hands out single units so larger spans always come from aligned_alloc()
+static void *pageBlockAlloc(size_t span, uint8_t *source){
+    if(gc.hugePages){
+        *source = span == BUFF_SIZE ? BLOCK_HUGE : BLOCK_MAPPED;
+
+        return span == BUFF_SIZE ? hugeBlockAlloc() : hugeSpanMap(span);
+    }
+
+    if(gc.freeMemory || span != BUFF_SIZE){
+        *source = BLOCK_HEAP;
+
+        return aligned_alloc(BUFF_SIZE, span);
+    }
+
+    *source = BLOCK_ARENA;
+
+    return arenaLocalAllocBuffsizeBlock(gc.arena);
+}
+
+// Gives a page's block back to wherever it came from (arena blocks stay until the arena is destroyed)
+static void pageBlockRelease(Page *page){
+    switch(page->blockSource){
+        case BLOCK_HEAP:
+            free(page->block);
+            break;
+        case BLOCK_HUGE:
+            hugeBlockRelease(page->block);
+            break;
+        case BLOCK_MAPPED:
+            osUnmap(page->block, page->spanSize);
+            break;
+        default:
+            break;
+    }
+}
+
+// Lays out an empty page as slots of slotSize bytes (a size class or a pool's slot size)
+// small slots are shifted by the next cache color, costing at most a few KB of slots per page
+// slots aligned to more than a cache line are not colored so they stay aligned
+static void pageFormat(Page *page, size_t slotSize, size_t align){
+    page->kind = PAGE_CLASS;
+    page->sizeClass = slotSize;
+
+    size_t color = 0;
+    if(page->sizeClass <= COLOR_MAX_CLASS && align <= COLOR_LINE){
+        color = (size_t)(gc.nextColor % COLOR_COUNT) * COLOR_LINE;
+        gc.nextColor++;
+    }
+    page->slots = (void *)((uintptr_t)page->block + color);
+    page->nslots = (uint32_t)((page->spanSize - color) / page->sizeClass);
+
+    page->inuseCount = 0;
+    page->allocCursor = 0;
+    page->markEpoch = gc.markEpoch;
+    page->blackCount = 0;
+    page->blackEpoch = gc.markEpoch;
+
+    // clear the words of the inuse bits this class uses (mark bits are set as slots are handed out)
+    // free slots are found from the inuse bits so the block itself is never written to
+    memset(page->inuseBits, 0, bitWords(page->nslots) * sizeof(uint64_t));
+}
+
+// Makes a page record with a new block of `span` bytes and adds it to the page index
+// the page still has to be formatted for what it will hold
+static Page *pageNew(size_t span){
+    Page *page = pageSlabAlloc();
     if(page == NULL){
         perror("[FATAL]: Could not allocate Page metadata.");
         gcDestroy();
@@ -355,101 +1177,83 @@ static Page *pageInitForClass(int classIndex){
         exit(52);
     }
 
-    // allocate raw data for page block aligned to buffsize from arena or regular memory pool based on settings
-    void *raw;
-    raw = gc.freeMemory ? aligned_alloc(BUFF_SIZE, BUFF_SIZE) : arenaLocalAllocBuffsizeBlock(gc.arena);
+    // allocate raw data for page block aligned to buffsize
+    void *raw = pageBlockAlloc(span, &page->blockSource);
     assert((((uintptr_t)raw) & (BUFF_SIZE - 1)) == 0 && "page not BUFF_SIZE-aligned");
     if(raw == NULL){
         perror("[FATAL]: Could not allocate Page block.");
-        free(page);
+        pageSlabFree(page);
         gcDestroy();
 
         exit(53);
     }
 
-    // initialize page
+    // initialize page (records are reused from the slab so nothing can be left over from the last page)
     page->block = raw;
-    page->sizeClass = sizeClasses[classIndex];
-    page->nslots = (uint32_t)(BUFF_SIZE / page->sizeClass);
-    page->inuseCount = 0;
-    page->freeHead = 0;
+    page->spanSize = span;
     page->nextPage = NULL;
+    page->kind = PAGE_CLASS;
+    page->evacuating = 0;
+    page->reserved = 0;
+    page->markEpoch = gc.markEpoch;
+    page->blackCount = 0;
+    page->blackEpoch = gc.markEpoch;
+    memset(page->decommitBits, 0, sizeof(page->decommitBits));
 
-    // number of bytes for bit arrays
-    size_t nbytes = (page->nslots + 7) / 8;
-    page->inuseBits = calloc(nbytes, 1);
-    page->markBits  = calloc(nbytes, 1);
-    if(page->inuseBits == NULL || page->markBits == NULL){
-        perror("[FATAL]: Could not allocate Page bitmaps.");
-        free(page->inuseBits);
-        free(page->markBits);
-        free(page);
-        gcDestroy();
+    pageIndexInsert(page);
 
-        exit(54);
-    }
+    return page;
+}
 
-    // build freelist with -1 as end marker
-    for(uint32_t i = 0; i < page->nslots; i++){
-        *slotNextPtr(page, i) = (i + 1 < page->nslots) ? (int32_t)(i + 1) : -1;
-    }
-    pageIndexInsert(page);
+// Initializes a page for slotSize slots and returns a pointer to said page
+// allocates the slot size's span of BUFF_SIZE units and breaks it up into slots
+static Page *pageInitForSlots(size_t slotSize, size_t align){
+    Page *page = pageNew(slotSpanUnits(slotSize) * BUFF_SIZE);
+    pageFormat(page, slotSize, align);
 
     return page;
 }
 
-// Resets and clears all data associated with a page and prepares it to hold a different size class of objects
-static void pageResetForClass(Page *page, int classIndex){
-    // base address and index entry remain valid
-    page->sizeClass = sizeClasses[classIndex];
-    page->nslots = (uint32_t)(BUFF_SIZE / page->sizeClass);
-    page->inuseCount = 0;
-    page->freeHead = 0;
-
-    // number of bytes for bit arrays
-    size_t nbytes = (page->nslots + 7) / 8;
-    free(page->inuseBits);
-    free(page->markBits);
-    page->inuseBits = calloc(nbytes, 1);
-    page->markBits  = calloc(nbytes, 1);
-    if(page->inuseBits == NULL || page->markBits == NULL){
-        perror("[FATAL]: Could not reallocate Page bitmaps.");
-        free(page->inuseBits);
-        free(page->markBits);
-        gcDestroy();
+// Initializes a page for a given class size and returns a pointer to said page
+static Page *pageInitForClass(int classIndex){
+    return pageInitForSlots(sizeClasses[classIndex], CLASS_ALIGN);
+}
 
-        exit(55);
-    }
+// Resets and clears all data associated with a page and prepares it to hold a different size of slots
+// the new slot size must use the same span as the page (see slotSpanUnits())
+static void pageResetForSlots(Page *page, size_t slotSize, size_t align){
+    // slots of the old class no longer line up with the decommit bits
+    pageForgetDecommits(page);
 
-    // reset freelist with -1 as end marker
-    for(uint32_t i = 0; i < page->nslots; i++){
-        *slotNextPtr(page, i) = (i + 1 < page->nslots) ? (int32_t)(i + 1) : -1;
-    }
+    // base address and index entry remain valid
+    pageFormat(page, slotSize, align);
 }
 
 // Destroys all metadata for a given page
 // removes page from lookup hash
 // if freeMemory togle is enabled then the memory if freed aswell
 static void pageDestroyMeta(Page *page){
-    // remove from hash
-    if(page->block) \
-        pageIndexRemove(page->block);
+    pageForgetDecommits(page);
+
+    // remove every unit from hash
+    for(size_t off = 0; page->block && off < page->spanSize; off += BUFF_SIZE){
+        pageIndexRemove((void *)((uintptr_t)page->block + off));
+    }
+    gc.book.numPages--;
 
     // page->block memory stays in the arena in arena mode
-    if(gc.freeMemory && page->block) \
-        free(page->block);
+    if(page->block) \
+        pageBlockRelease(page);
 
-    free(page->inuseBits);
-    free(page->markBits);
     page->block = NULL;
-    page->inuseBits = NULL;
-    page->markBits = NULL;
+    page->slots = NULL;
+    page->spanSize = 0;
     page->nslots = 0;
     page->inuseCount = 0;
-    page->freeHead = -1;
+    page->allocCursor = 0;
     page->sizeClass = 0;
     page->nextPage = NULL;
-    free(page);
+    pageSlabFree(page);
 }
 
 // ===============
@@ -460,9 +1264,19 @@ static void pageDestroyMeta(Page *page){
 static void bookInit(Book *book){
     for(size_t i = 0; i < NUM_CLASSES; i++){
         book->classPages[i] = NULL;
+        book->classCursor[i] = NULL;
+        book->movablePages[i] = NULL;
+        book->movableCursor[i] = NULL;
     }
 
     book->emptyPages = NULL;
+    book->pools = NULL;
+    book->regions = NULL;
+    book->permanent.pages = NULL;
+    book->permanent.cursor = 0;
+    book->permanent.limit = 0;
+    book->immixPages = NULL;
+    book->immixCursor = NULL;
     book->numPages = 0;
 }
 
@@ -480,8 +1294,40 @@ static void bookDestroy(Book *book){
     for(size_t i = 0; i < NUM_CLASSES; i++){
         pagesDestroyList(book->classPages[i]);
         book->classPages[i] = NULL;
+        book->classCursor[i] = NULL;
+
+        pagesDestroyList(book->movablePages[i]);
+        book->movablePages[i] = NULL;
+        book->movableCursor[i] = NULL;
+    }
+
+    // pools go with their pages
+    while(book->pools){
+        GCPool *pool = book->pools;
+        book->pools = pool->nextPool;
+
+        pagesDestroyList(pool->pages);
+        free(pool);
+    }
+
+    // so do open regions
+    while(book->regions){
+        GCRegion *region = book->regions;
+        book->regions = region->nextRegion;
+
+        pagesDestroyList(region->pages);
+        free(region);
     }
 
+    pagesDestroyList(book->permanent.pages);
+    book->permanent.pages = NULL;
+    book->permanent.cursor = 0;
+    book->permanent.limit = 0;
+
+    pagesDestroyList(book->immixPages);
+    book->immixPages = NULL;
+    book->immixCursor = NULL;
+
     pagesDestroyList(book->emptyPages);
     book->emptyPages = NULL;
     book->numPages = 0;
@@ -491,27 +1337,40 @@ static void bookDestroy(Book *book){
 // Roots Array
 // ===========
 
-// Adds an explicit root to the list of roots
-// anything that is added will not be freed by the GC until it is unmarked
-static void addRoot(void **root){
-    // if roots array is empty
-    if(gc.rootsLen == 0){
-        gc.roots = malloc(sizeof(void **) * 16);
-        if(gc.roots == NULL){
-            perror("[FATAL]: Could not allocate GC roots.");
-            gcDestroy();
+// Returns where a root sits in the root index, or the empty position it would be inserted at
+static inline size_t rootIndexFind(void **root){
+    size_t mask = gc.rootIndexCap - 1;
+    size_t pos = (size_t)hash64((uintptr_t)root) & mask;
 
-            exit(50);
-        }
-        gc.rootsCap = 16;
-        gc.roots[0] = root;
-        gc.rootsLen++;
+    while(gc.rootIndex[pos] && gc.roots[gc.rootIndex[pos] - 1] != root){
+        pos = (pos + 1) & mask;
+    }
+
+    return pos;
+}
+
+// Rebuilds the root index at a new capacity (power of two) from the roots array
+static void rootIndexRebuild(size_t cap){
+    uint32_t *temp = calloc(cap, sizeof(uint32_t));
+    if(temp == NULL){
+        perror("[FATAL]: Could not allocate GC root index.");
+        gcDestroy();
+
+        exit(61);
+    }
+    free(gc.rootIndex);
+    gc.rootIndex = temp;
+    gc.rootIndexCap = cap;
 
-        return; // exit and skip adding
+    for(size_t r = 0; r < gc.rootsLen; r++){
+        gc.rootIndex[rootIndexFind(gc.roots[r])] = (uint32_t)(r + 1);
     }
-    // if roots array needs to be expanded
-    else if((gc.rootsLen) >= gc.rootsCap){
-        void ***temp = realloc(gc.roots, sizeof(void **) * (gc.rootsCap * 2));
+}
+
+// Grows the roots array and its index once so `count` roots fit without growing again
+static void rootsReserve(size_t count){
+    if(count > gc.rootsCap){
+        void ***temp = realloc(gc.roots, sizeof(void **) * count);
         if(temp == NULL){
             perror("[FATAL]: Could not reallocate GC roots.");
             gcDestroy();
@@ -519,37 +1378,111 @@ static void addRoot(void **root){
             exit(51);
         }
         gc.roots = temp;
-        gc.rootsCap *= 2;
+        gc.rootsCap = count;
     }
 
-    // try to add root into vacant slot
-    for(size_t i = 0; i < gc.rootsLen; i++){
-        if(gc.roots[i] == NULL || gc.roots[i] == root){
-            gc.roots[i] = root;
+    // smallest power of two that keeps the index under 70% full
+    size_t cap = gc.rootIndexCap ? gc.rootIndexCap : 32;
+    while(count * 10 >= cap * 7) \
+        cap <<= 1;
 
-            return; // exit early
-        }
-    }
+    if(cap != gc.rootIndexCap) \
+        rootIndexRebuild(cap);
+}
 
-    // add at end as last resort
-    gc.roots[gc.rootsLen] = root;
+// Adds an explicit root to the list of roots
+// anything that is added will not be freed by the GC until it is unmarked
+// roots are kept dense in gc.roots and found through gc.rootIndex (slot holds index + 1, 0 is empty) so adding is O(1)
+static void addRoot(void **root){
+    // double the array when full
+    if(gc.rootsLen >= gc.rootsCap) \
+        rootsReserve(gc.rootsCap ? gc.rootsCap * 2 : 16);
+
+    // already rooted
+    size_t pos = rootIndexFind(root);
+    if(gc.rootIndex[pos]) \
+        return;
+
+    gc.roots[gc.rootsLen] = root;
     gc.rootsLen++;
+    gc.rootIndex[pos] = (uint32_t)gc.rootsLen;
 }
 
 // Removes an explicit root based off of it's address
+// the last root is moved into its place in the array so it stays dense, both in O(1)
 static bool removeRoot(void **root){
-    // search to find the root
-    for(size_t i = 0; i < gc.rootsLen; i++){
-        if(gc.roots[i] == root){
-            // set it to null and exit
-            gc.roots[i] = NULL;
+    if(gc.rootIndexCap == 0) \
+        return false;
+
+    size_t pos = rootIndexFind(root);
+    if(gc.rootIndex[pos] == 0) \
+        return false;   // couldn't find anything
 
-            return true;
+    size_t r = gc.rootIndex[pos] - 1;
+    size_t mask = gc.rootIndexCap - 1;
+
+    // clear the slot and move the rest of its cluster back into the gap so lookups never stop short
+    gc.rootIndex[pos] = 0;
+    for(size_t next = (pos + 1) & mask; gc.rootIndex[next]; next = (next + 1) & mask){
+        uint32_t val = gc.rootIndex[next];
+        gc.rootIndex[next] = 0;
+        gc.rootIndex[rootIndexFind(gc.roots[val - 1])] = val;
+    }
+
+    // fill the hole in the array with the last root
+    gc.rootsLen--;
+    if(r != gc.rootsLen){
+        void **last = gc.roots[gc.rootsLen];
+        gc.roots[r] = last;
+        gc.rootIndex[rootIndexFind(last)] = (uint32_t)(r + 1);
+    }
+
+    return true;
+}
+
+// Returns where the root range starting at low sits in the ranges array, or rootRangesLen if it is not registered
+static size_t rootRangeFind(uintptr_t low){
+    size_t r = 0;
+    while(r < gc.rootRangesLen && gc.rootRanges[r].low != low) \
+        r++;
+
+    return r;
+}
+
+// Adds a block of memory to the list of root ranges, or resizes it if a range already starts at low
+static void addRootRange(uintptr_t low, uintptr_t high){
+    size_t r = rootRangeFind(low);
+    if(r == gc.rootRangesLen){
+        // double the array when full
+        if(gc.rootRangesLen >= gc.rootRangesCap){
+            size_t newCap = gc.rootRangesCap ? gc.rootRangesCap * 2 : 8;
+            RootRange *temp = realloc(gc.rootRanges, sizeof(RootRange) * newCap);
+            if(temp == NULL){
+                perror("[FATAL]: Could not reallocate GC root ranges.");
+                gcDestroy();
+
+                exit(63);
+            }
+            gc.rootRanges = temp;
+            gc.rootRangesCap = newCap;
         }
+        gc.rootRangesLen++;
     }
 
-    // couldn't find anything
-    return false;
+    gc.rootRanges[r].low = low;
+    gc.rootRanges[r].high = high;
+}
+
+// Removes the root range starting at low, the last range is moved into its place so the array stays dense
+static bool removeRootRange(uintptr_t low){
+    size_t r = rootRangeFind(low);
+    if(r == gc.rootRangesLen) \
+        return false;   // couldn't find anything
+
+    gc.rootRangesLen--;
+    gc.rootRanges[r] = gc.rootRanges[gc.rootRangesLen];
+
+    return true;
 }
 
 // ===========================
@@ -564,6 +1497,22 @@ static size_t recomputeLiveBytes(){
         for(Page *page = gc.book.classPages[c]; page != NULL; page = page->nextPage){   // while there are still pages to be counted
             live += (size_t)page->inuseCount * page->sizeClass; // add the number of bytes it is curently using
         }
+        for(Page *page = gc.book.movablePages[c]; page != NULL; page = page->nextPage){
+            live += (size_t)page->inuseCount * page->sizeClass;
+        }
+    }
+
+    for(GCPool *pool = gc.book.pools; pool != NULL; pool = pool->nextPool){
+        for(Page *page = pool->pages; page != NULL; page = page->nextPage){
+            live += (size_t)page->inuseCount * page->sizeClass;
+        }
+    }
+
+    // Immix pages hold on to whole lines
+    for(Page *page = gc.book.immixPages; page != NULL; page = page->nextPage){
+        for(size_t w = 0; w < IMMIX_LINE_WORDS; w++){
+            live += (size_t)bitPopcount(page->lineBits[w]) * IMMIX_LINE_SIZE;
+        }
     }
 
     return live;
@@ -584,71 +1533,347 @@ static inline void maybeCollectOnPressure(size_t upcomingAllocBytes){
 // Allocation Helpers
 // ==================
 
-// Allocates memory to any empty page slots in size class or makes a new page
-// computes whether or not a collection is necessary and increments bytes since last gc
-static void *allocFromClass(int classIndex){
-    // check pressure before considering new pages
-    maybeCollectOnPressure(sizeClasses[classIndex]);
+// Returns how many free slots (Immix lines) on a page the last collection blacklisted
+// a count left by an older collection is stale and reads as none
+static inline uint32_t pageBlackCount(Page *page){
+    return page->blackEpoch == gc.markEpoch ? page->blackCount : 0;
+}
+
+// Hands out the lowest free slot on a page and returns its index (the page must have a free slot)
+// finds the first zero inuse bit a word at a time starting from the page's cursor, the slot's memory is not touched
+// the slot's mark bit is set to read as unmarked for the next collection
+// blacklisted slots are skipped, callers only take from pages with a free slot that is not blacklisted
+static inline uint32_t pageTakeSlot(Page *page){
+    size_t w = page->allocCursor;
+    uint64_t freeBits;
+    if(pageBlackCount(page) == 0){
+        freeBits = ~page->inuseBits[w] & bitWordMask(page->nslots, w);
+        while(freeBits == 0){
+            w++;
+            freeBits = ~page->inuseBits[w] & bitWordMask(page->nslots, w);
+        }
+    }
+    else{
+        freeBits = ~(page->inuseBits[w] | page->blackBits[w]) & bitWordMask(page->nslots, w);
+        while(freeBits == 0){
+            w++;
+            freeBits = ~(page->inuseBits[w] | page->blackBits[w]) & bitWordMask(page->nslots, w);
+        }
+    }
+    page->allocCursor = (uint32_t)w;
+    uint32_t idx = (uint32_t)(w * 64 + bitLowest(freeBits));
 
-    // try existing pages for this class
-    for(Page *page = gc.book.classPages[classIndex]; page != NULL; page = page->nextPage){
-        // if the current page is open
-        if(page->freeHead != -1){
-            uint32_t idx = (uint32_t)page->freeHead;
+    // add to page
+    page->inuseCount++;
+    page->inuseBits[bitWord(idx)] |= bitMask(idx);
+    if(page->sizeClass >= DECOMMIT_MIN_SIZE) \
+        slotRecommit(page, idx);
+    if(page->markEpoch & 1) \
+        page->markBits[bitWord(idx)] |= bitMask(idx);
+    else
+        page->markBits[bitWord(idx)] &= ~bitMask(idx);
+
+    return idx;
+}
 
-            // add to page
-            page->freeHead = *slotNextPtr(page, idx);
-            page->inuseCount++;
-            page->inuseBits[bitByte(idx)] |= bitMask(idx);
+// Unlinks and returns a cached empty page whose block spans `span` bytes, or NULL if there is none
+// the page still has to be formatted for what it will hold
+// pages a false pointer hit during the last collection are left cached so the pointer cannot land in whatever they are formatted for next
+static Page *pageTakeEmpty(size_t span){
+    Page **link = &gc.book.emptyPages;
+    while(*link && ((*link)->spanSize != span || pageBlackCount(*link))) \
+        link = &(*link)->nextPage;
+
+    Page *page = *link;
+    if(page != NULL){
+        *link = page->nextPage;
+        page->nextPage = NULL;
 
-            // add number of bytes since last GC
-            gc.bytesSinceLastGC += sizeClasses[classIndex];
+        // slots of the old layout no longer line up with the decommit bits
+        pageForgetDecommits(page);
+    }
+
+    return page;
+}
+
+// Takes a slot from a list of pages of slotSize slots, reusing an empty page or making a new one (of the given kind) if they are all full
+// *cursor is the first page in the list that may have a free slot
+// never collects so it is safe to use while a collection is moving objects
+static void *takeFromPages(Page **pages, Page **cursor, size_t slotSize, size_t align, PageKind kind){
+    // try existing pages starting from the first one that is not known to be full
+    for(Page *page = *cursor; page != NULL; page = page->nextPage){
+        // if the current page is open (free slots that are all blacklisted do not count)
+        if(page->inuseCount + pageBlackCount(page) < page->nslots){
+            *cursor = page;
+            uint32_t idx = pageTakeSlot(page);
 
             return slotBase(page, idx); // exit early
         }
     }
 
-    // reuse an empty page if available
-    if(gc.book.emptyPages != NULL){
-        // move page to emptypages
-        Page *page = gc.book.emptyPages;
-        gc.book.emptyPages = page->nextPage;
-        page->nextPage = NULL;
+    // reuse an empty page with the slot size's span if available
+    Page *page = pageTakeEmpty(slotSpanUnits(slotSize) * BUFF_SIZE);
+    if(page != NULL){
+        // reset the page for needed slot size
+        pageResetForSlots(page, slotSize, align);
+    }
+    else{
+        // make a new page as last resort
+        page = pageInitForSlots(slotSize, align);
+        gc.book.numPages++;
+    }
+    page->kind = (uint8_t)kind;
+    page->evacuating = 0;
+
+    // push front into the list
+    page->nextPage = *pages;
+    *pages = page;
+    *cursor = page;
+
+    uint32_t idx = pageTakeSlot(page);
+
+    return slotBase(page, idx);
+}
+
+// Allocates a slot from a list of pages of slotSize slots
+// computes whether or not a collection is necessary and increments bytes since last gc
+static void *allocFromPages(Page **pages, Page **cursor, size_t slotSize, size_t align){
+    // check pressure before considering new pages
+    maybeCollectOnPressure(slotSize);
+
+    // add number of bytes since last GC
+    gc.bytesSinceLastGC += slotSize;
 
-        // reset the page for needed class
-        pageResetForClass(page, classIndex);
+    return takeFromPages(pages, cursor, slotSize, align, PAGE_CLASS);
+}
+
+// Allocates memory to any empty page slots in size class or makes a new page
+static inline void *allocFromClass(int classIndex){
+    return allocFromPages(&gc.book.classPages[classIndex], &gc.book.classCursor[classIndex], sizeClasses[classIndex], CLASS_ALIGN);
+}
 
-        uint32_t idx = (uint32_t)page->freeHead;
-        page->freeHead = *slotNextPtr(page, idx);
-        page->inuseCount++;
-        page->inuseBits[bitByte(idx)] |= bitMask(idx);
+// ============
+// Immix Engine
+// ============
 
-        // push front into class list
-        page->nextPage = gc.book.classPages[classIndex];
-        gc.book.classPages[classIndex] = page;
+// Lays out an empty page for the Immix engine as granules with every line free
+static void immixFormat(Page *page){
+    page->kind = PAGE_IMMIX;
+    page->sizeClass = IMMIX_GRANULE;
+    page->slots = page->block;
+    page->nslots = (uint32_t)(page->spanSize / IMMIX_GRANULE);
 
-        // add number of bytes to since last GC
-        gc.bytesSinceLastGC += sizeClasses[classIndex];
+    page->inuseCount = 0;
+    page->allocCursor = 0;  // first line to look for free lines from
+    page->markEpoch = gc.markEpoch;
+    page->blackCount = 0;
+    page->blackEpoch = gc.markEpoch;
+
+    memset(page->inuseBits, 0, bitWords(page->nslots) * sizeof(uint64_t));
+    memset(page->endBits, 0, bitWords(page->nslots) * sizeof(uint64_t));
+    memset(page->lineBits, 0, sizeof(page->lineBits));
+}
 
-        return slotBase(page, idx); // exit early
+// Returns an empty page formatted for the Immix engine and pushed onto its page list
+// reuses a cached empty page before making a new one
+static Page *immixFreshPage(){
+    Page *page = pageTakeEmpty(BUFF_SIZE);
+    if(page == NULL){
+        page = pageNew(BUFF_SIZE);
+        gc.book.numPages++;
     }
+    immixFormat(page);
 
-    // make a new page as last resort
-    Page *page = pageInitForClass(classIndex);
+    page->nextPage = gc.book.immixPages;
+    gc.book.immixPages = page;
 
-    // push front into class list
-    page->nextPage = gc.book.classPages[classIndex];
-    gc.book.classPages[classIndex] = page;
-    gc.book.numPages++;
+    return page;
+}
+
+// Returns the index of the first line at or after `from` that is in use (marked or blacklisted) if used is true or free if it is false
+// returns nlines if there is none
+static inline size_t immixLineNext(Page *page, size_t nlines, size_t from, bool used){
+    if(pageBlackCount(page) == 0) \
+        return bitNext(page->lineBits, nlines, from, used);
+    if(from >= nlines) \
+        return nlines;
+
+    uint64_t flip = used ? 0 : ~(uint64_t)0;
+    size_t w = bitWord(from);
+    uint64_t word = ((page->lineBits[w] | page->blackLines[w]) ^ flip) & ~(bitMask(from) - 1) & bitWordMask(nlines, w);
+    while(word == 0){
+        if(++w >= bitWords(nlines)) \
+            return nlines;
+        word = ((page->lineBits[w] | page->blackLines[w]) ^ flip) & bitWordMask(nlines, w);
+    }
 
-    uint32_t idx = (uint32_t)page->freeHead;
-    page->freeHead = *slotNextPtr(page, idx);
+    return w * 64 + bitLowest(word);
+}
+
+// Moves a bump region onto the next run of free lines on a page starting from the page's cursor
+// lines the last collection blacklisted are skipped like marked ones
+// returns false once the page has no runs left (until the next sweep)
+static bool immixNextHole(Page *page, BumpRegion *region){
+    size_t nlines = page->spanSize / IMMIX_LINE_SIZE;
+    size_t first = immixLineNext(page, nlines, page->allocCursor, false);
+    size_t end = immixLineNext(page, nlines, first, true);
+
+    page->allocCursor = (uint32_t)end;
+    if(first == end) \
+        return false;
+
+    region->page = page;
+    region->cursor = (uintptr_t)page->block + first * IMMIX_LINE_SIZE;
+    region->limit = (uintptr_t)page->block + end * IMMIX_LINE_SIZE;
+
+    return true;
+}
+
+// Moves the main bump region onto the next run of free lines
+// tries the rest of the current page, then pages the last sweep left free lines on, then a fresh page
+static void immixRefill(BumpRegion *region){
+    if(region->page && immixNextHole(region->page, region)) \
+        return;
+
+    while(gc.book.immixCursor){
+        Page *page = gc.book.immixCursor;
+        gc.book.immixCursor = page->nextPage;
+
+        if(immixNextHole(page, region)) \
+            return;
+    }
+
+    immixNextHole(immixFreshPage(), region);
+}
+
+// Bump allocates `size` bytes rounded up to granules
+// small objects move on to the next run of free lines when the current one is full
+// medium objects (over a line) that do not fit the current run go to the overflow region on fresh pages so small runs are not skipped over
+static void *immixAlloc(size_t size){
+    size_t bytes = ALIGN_UP(size ? size : 1, IMMIX_GRANULE);
+
+    // check pressure before the bump regions are used (a collection resets them)
+    maybeCollectOnPressure(bytes);
+
+    BumpRegion *region = &gc.immixBump;
+    if(region->limit - region->cursor < bytes){
+        if(bytes > IMMIX_LINE_SIZE){
+            region = &gc.immixOverflow;
+            if(region->limit - region->cursor < bytes) \
+                immixNextHole(immixFreshPage(), region);
+        }
+        else{
+            immixRefill(region);
+        }
+    }
+
+    Page *page = region->page;
+    uint32_t first = (uint32_t)((region->cursor - (uintptr_t)page->block) / IMMIX_GRANULE);
+    uint32_t last = first + (uint32_t)(bytes / IMMIX_GRANULE) - 1;
+    region->cursor += bytes;
+
+    // the object is its first granule's inuse bit and last granule's end bit
     page->inuseCount++;
-    page->inuseBits[bitByte(idx)] |= bitMask(idx);
+    page->inuseBits[bitWord(first)] |= bitMask(first);
+    page->endBits[bitWord(last)] |= bitMask(last);
+    if(page->markEpoch & 1) \
+        page->markBits[bitWord(first)] |= bitMask(first);
+    else
+        page->markBits[bitWord(first)] &= ~bitMask(first);
 
-    gc.bytesSinceLastGC += sizeClasses[classIndex];
+    gc.bytesSinceLastGC += bytes;
+
+    return slotBase(page, first);
+}
+
+// Returns the last granule of the object starting at granule `first`
+static inline uint32_t immixObjectEnd(Page *page, uint32_t first){
+    return (uint32_t)bitNext(page->endBits, page->nslots, first, true);
+}
+
+// Moves *idx back to the first granule of the object covering it
+// returns false if the granule is not inside an allocated object
+static inline bool immixObjectStart(Page *page, uint32_t *idx){
+    // objects are never longer than IMMIX_MAX_OBJECT so starts further back cannot cover idx
+    size_t reach = IMMIX_MAX_OBJECT / IMMIX_GRANULE;
+    size_t first = bitPrevSet(page->inuseBits, *idx, *idx >= reach ? *idx - reach : 0);
+    if(first == SIZE_MAX || immixObjectEnd(page, (uint32_t)first) < *idx) \
+        return false;
+
+    *idx = (uint32_t)first;
+
+    return true;
+}
+
+// Marks every line an object from granule first to last touches
+static inline void immixMarkLines(Page *page, uint32_t first, uint32_t last){
+    size_t hi = (size_t)last * IMMIX_GRANULE / IMMIX_LINE_SIZE;
+    for(size_t l = (size_t)first * IMMIX_GRANULE / IMMIX_LINE_SIZE; l <= hi; l++){
+        page->lineBits[bitWord(l)] |= bitMask(l);
+    }
+}
 
-    return slotBase(page, idx); // return new page's base
+// Clears the line marks of every Immix page before a collection marks the lines still in use
+static void immixClearLineMarks(){
+    for(Page *page = gc.book.immixPages; page != NULL; page = page->nextPage){
+        memset(page->lineBits, 0, sizeof(page->lineBits));
+    }
+}
+
+// =================
+// Region Bump Pages
+// =================
+
+// Lays out an empty page for a region (PAGE_REGION or PAGE_PERMANENT), it has no slots so pointers into it are never marked
+static void regionFormat(Page *page, PageKind kind){
+    page->kind = (uint8_t)kind;
+    page->sizeClass = page->spanSize;
+    page->slots = page->block;
+    page->nslots = 0;
+
+    page->inuseCount = 0;
+    page->allocCursor = 0;  // bytes handed out
+    page->markEpoch = gc.markEpoch;
+    page->blackCount = 0;
+    page->blackEpoch = gc.markEpoch;
+}
+
+// Starts a new page for a region big enough for `bytes` and makes it the page being bump allocated into
+// the previous page keeps how many bytes it handed out so only those are scanned
+static void regionNewPage(GCRegion *region, size_t bytes, PageKind kind){
+    if(region->pages) \
+        region->pages->allocCursor = (uint32_t)(region->cursor - (uintptr_t)region->pages->block);
+
+    // objects too big for a page get a span of their own
+    size_t span = ALIGN_UP(bytes, BUFF_SIZE);
+    Page *page = pageTakeEmpty(span);
+    if(page == NULL){
+        page = pageNew(span);
+        gc.book.numPages++;
+    }
+    regionFormat(page, kind);
+
+    page->nextPage = region->pages;
+    region->pages = page;
+    region->cursor = (uintptr_t)page->block;
+    region->limit = (uintptr_t)page->block + page->spanSize;
+}
+
+// Returns the number of bytes a region has handed out from one of its pages
+static inline size_t regionPageUsed(GCRegion *region, Page *page){
+    return page == region->pages ? (size_t)(region->cursor - (uintptr_t)page->block) : page->allocCursor;
+}
+
+// Bump allocates `size` bytes rounded up to CLASS_ALIGN from a region, starting a page of the given kind if it is full
+static void *regionAlloc(GCRegion *region, size_t size, PageKind kind){
+    size_t bytes = ALIGN_UP(size ? size : 1, CLASS_ALIGN);
+    if(region->limit - region->cursor < bytes) \
+        regionNewPage(region, bytes, kind);
+
+    void *ptr = (void *)region->cursor;
+    region->cursor += bytes;
+
+    return ptr;
 }
 
 // ==============================
@@ -658,37 +1883,307 @@ static void *allocFromClass(int classIndex){
 static void markPtr(void *ptr);
 // fwd declaration
 
-// Walks the stack and casts everything to a pointer then tries to mark anything it manages
-static void scanStackForRoots(){
-    volatile int here;  // try to flush all registers by adding a volatile to the stack
+// Tries to mark every word in an array that falls inside the heap bounds
+// one unsigned compare against the bounds rules out NULL, small integers and pointers elsewhere before markPtr() hashes them
+static void scanWordsScalar(const uintptr_t *words, size_t n){
+    uintptr_t low = heapLow;
+    uintptr_t span = heapHigh - heapLow;
+
+    for(size_t i = 0; i < n; i++){
+        if(words[i] - low < span) \
+            markPtr((void *)words[i]);
+    }
+}
+
+#if REMEM_HAVE_AVX2
+// Same as scanWordsScalar() but tests 8 words at a time against the heap bounds with AVX2
+// AVX2 only compares signed 64 bit lanes so both sides are offset by the sign bit to get an unsigned compare
+__attribute__((target("avx2")))
+static void scanWordsAVX2(const uintptr_t *words, size_t n){
+    uintptr_t low = heapLow;
+    uintptr_t span = heapHigh - heapLow;
+
+    const __m256i sign = _mm256_set1_epi64x((long long)((uint64_t)1 << 63));
+    const __m256i vlow = _mm256_set1_epi64x((long long)low);
+    const __m256i vspan = _mm256_xor_si256(_mm256_set1_epi64x((long long)span), sign);
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256i a = _mm256_xor_si256(_mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(words + i)), vlow), sign);
+        __m256i b = _mm256_xor_si256(_mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(words + i + 4)), vlow), sign);
+
+        // lanes where span > word - low
+        int hits = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vspan, a)))
+                 | _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vspan, b))) << 4;
+        while(hits){
+            int lane = __builtin_ctz((unsigned)hits);
+            markPtr((void *)words[i + lane]);
+            hits &= hits - 1;
+        }
+    }
+
+    scanWordsScalar(words + i, n - i);
+}
+#endif
+
+#if REMEM_HAVE_NEON
+// Same as scanWordsScalar() but tests 8 words at a time against the heap bounds with NEON
+static void scanWordsNEON(const uintptr_t *words, size_t n){
+    uintptr_t low = heapLow;
+    uintptr_t span = heapHigh - heapLow;
+
+    const uint64x2_t vlow = vdupq_n_u64(low);
+    const uint64x2_t vspan = vdupq_n_u64(span);
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        const uint64_t *w = (const uint64_t *)(words + i);
+        uint64x2_t a = vcltq_u64(vsubq_u64(vld1q_u64(w), vlow), vspan);
+        uint64x2_t b = vcltq_u64(vsubq_u64(vld1q_u64(w + 2), vlow), vspan);
+        uint64x2_t c = vcltq_u64(vsubq_u64(vld1q_u64(w + 4), vlow), vspan);
+        uint64x2_t d = vcltq_u64(vsubq_u64(vld1q_u64(w + 6), vlow), vspan);
+
+        // most blocks have no candidates at all, only those get checked word by word
+        if(vmaxvq_u32(vreinterpretq_u32_u64(vorrq_u64(vorrq_u64(a, b), vorrq_u64(c, d)))) == 0) \
+            continue;
+
+        scanWordsScalar(words + i, 8);
+    }
+
+    scanWordsScalar(words + i, n - i);
+}
+#endif
+
+// Word filter used by every conservative scan, picked by scanWordsSelect() when the GC is initialized
+static void (*scanWords)(const uintptr_t *words, size_t n) = scanWordsScalar;
+
+// Picks the fastest word filter the CPU running the GC supports
+static void scanWordsSelect(){
+    scanWords = scanWordsScalar;
+#if REMEM_HAVE_AVX2
+    if(__builtin_cpu_supports("avx2")) \
+        scanWords = scanWordsAVX2;
+#endif
+#if REMEM_HAVE_NEON
+    scanWords = scanWordsNEON;
+#endif
+}
+
+// Casts every aligned word in [low, high) to a pointer and tries to mark anything it manages
+static void scanRangeConservative(uintptr_t low, uintptr_t high){
+    uintptr_t *first = (uintptr_t *)ALIGN_UP(low, sizeof(uintptr_t));
+    if((uintptr_t)first < high) \
+        scanWords(first, (size_t)(high - (uintptr_t)first) / sizeof(uintptr_t));
+}
+
+// Drops the stack checkpoint so collections scan the whole stack again
+static void stackCheckpointClear(){
+    gc.stackCheckpoint = 0;
+    gc.checkpointLen = 0;
+}
+
+// Keeps the words in [low, high) that point into a GC page so collections can mark from them instead of rescanning the frames
+// words that point anywhere else could not keep anything alive, whatever is allocated there later is newer than the frames
+static void stackCheckpointCapture(uintptr_t low, uintptr_t high){
+    gc.checkpointLen = 0;
+    for(uintptr_t *w = (uintptr_t *)ALIGN_UP(low, sizeof(uintptr_t)); w < (uintptr_t *)high; w++){
+        if(*w - heapLow >= heapHigh - heapLow || pageIndexFindByAddr((void *)(*w)) == NULL) \
+            continue;
+
+        // double the array when full
+        if(gc.checkpointLen >= gc.checkpointCap){
+            size_t newCap = gc.checkpointCap ? gc.checkpointCap * 2 : 256;
+            uintptr_t *temp = realloc(gc.checkpointWords, sizeof(uintptr_t) * newCap);
+            if(temp == NULL){
+                perror("[FATAL]: Could not reallocate GC stack checkpoint.");
+                gcDestroy();
+
+                exit(64);
+            }
+            gc.checkpointWords = temp;
+            gc.checkpointCap = newCap;
+        }
+        gc.checkpointWords[gc.checkpointLen++] = *w;
+    }
+
+#ifndef NDEBUG
+    size_t len = high > low ? (size_t)(high - ALIGN_UP(low, sizeof(uintptr_t))) / sizeof(uintptr_t) : 0;
+    uintptr_t *copy = realloc(gc.checkpointCopy, sizeof(uintptr_t) * (len ? len : 1));
+    if(copy == NULL){
+        perror("[FATAL]: Could not reallocate GC stack checkpoint.");
+        gcDestroy();
+
+        exit(64);
+    }
+    const uintptr_t *w = (const uintptr_t *)ALIGN_UP(low, sizeof(uintptr_t));
+    for(size_t i = 0; i < len; i++){
+        copy[i] = w[i];
+    }
+    gc.checkpointCopy = copy;
+    gc.checkpointCopyLen = len;
+#endif
+}
+
+#ifndef NDEBUG
+// Debug builds check that no word of the checkpointed frames in [low, high) was changed to point into a GC page since the checkpoint
+// such a word is never scanned so the object it points to could be freed while in use (an out parameter or &local written by a newer frame)
+static void stackCheckpointVerify(uintptr_t low, uintptr_t high){
+    const uintptr_t *w = (const uintptr_t *)ALIGN_UP(low, sizeof(uintptr_t));
+    for(size_t i = 0; i < gc.checkpointCopyLen && (uintptr_t)&w[i] < high; i++){
+        uintptr_t word = w[i];
+        if(word == gc.checkpointCopy[i] || word - heapLow >= heapHigh - heapLow || pageIndexFindByAddr((void *)word) == NULL) \
+            continue;
+
+        fprintf(stderr, "[FATAL]: Checkpointed stack word at %p was changed to point at GC memory %p, root it with GC_MARK or clear the checkpoint before changing it.\n", (void *)&w[i], (void *)word);
+        abort();
+    }
+}
+#endif
 
-    uintptr_t low = (uintptr_t)&here;   // also doubles as a hint to where the bottom of the stack is
+// Walks the running main stack from sp to stack_top_hint and casts everything to a pointer then tries to mark anything it manages
+// with a checkpoint only the frames newer than it are walked, the older ones mark from the words the checkpoint kept
+static void scanMainStack(uintptr_t sp){
+    uintptr_t low = sp;
     uintptr_t high = (uintptr_t)gc.stack_top_hint;
+    bool growsDown = low < high;
 
     // swap them if they are backwards
     if(low > high){
         uintptr_t t = low; low = high; high = t;
     }
 
-    // cast everything in the stack as a pointer and attempt to mark it if it is in the arena
-    for(uintptr_t *w = (uintptr_t *)low; w < (uintptr_t *)high; w++){
-        markPtr((void *)(*w));
+    // a checkpoint above the running frame was left set after its frame returned, it no longer describes any live frame
+    // (this only catches a collection run from a shallower frame, deeper frames that reused its stack cannot be told apart)
+    if(gc.stackCheckpoint && (gc.stackCheckpoint < low || gc.stackCheckpoint > high)) \
+        stackCheckpointClear();
+
+    if(gc.stackCheckpoint == 0){
+        scanRangeConservative(low, high);
+        return;
+    }
+
+    if(growsDown) \
+        scanRangeConservative(low, gc.stackCheckpoint);
+    else \
+        scanRangeConservative(gc.stackCheckpoint, high);
+
+#ifndef NDEBUG
+    if(growsDown) \
+        stackCheckpointVerify(gc.stackCheckpoint, high);
+    else \
+        stackCheckpointVerify(low, gc.stackCheckpoint);
+#endif
+
+    for(size_t w = 0; w < gc.checkpointLen; w++){
+        markPtr((void *)gc.checkpointWords[w]);
+    }
+}
+
+// Scans the part of a stack in use from sp to its base (whichever way the stack grows)
+// a sp outside of the stack's bounds scans all of it
+static void scanStackExtent(GCStack *stack, uintptr_t sp){
+    uintptr_t low = stack->low;
+    uintptr_t high = stack->high;
+
+    // the main stack only has its top
+    if(stack == &gc.mainStack){
+        if(gc.stack_top_hint == NULL) \
+            return;
+        uintptr_t top = (uintptr_t)gc.stack_top_hint;
+        low = gc.stackGrowsDown ? sp : top;
+        high = gc.stackGrowsDown ? top : sp + sizeof(uintptr_t);
+    }
+    else if(sp >= low && sp < high){
+        if(gc.stackGrowsDown) \
+            low = sp;
+        else \
+            high = sp + sizeof(uintptr_t);
+    }
+
+    scanRangeConservative(low, high);
+}
+
+// Scans a suspended stack's frames and the registers it was suspended with
+static void scanSuspendedStack(GCStack *stack){
+    if(stack->sp){
+        scanStackExtent(stack, stack->sp);
+        scanRangeConservative((uintptr_t)&stack->regs, (uintptr_t)&stack->regs + sizeof(jmp_buf));
+    }
+
+    if(stack->ctx) \
+        scanRangeConservative((uintptr_t)stack->ctx, (uintptr_t)stack->ctx + stack->ctxLen);
+}
+
+// Walks the stack and casts everything to a pointer then tries to mark anything it manages
+// then does the same for every suspended stack (the main stack too while a fiber is running)
+static void scanStackForRoots(){
+    volatile int here;  // try to flush all registers by adding a volatile to the stack
+
+    // `here` is only int aligned so start from the word holding it
+    uintptr_t sp = ALIGN_DOWN((uintptr_t)&here, sizeof(uintptr_t));   // also doubles as a hint to where the bottom of the stack is
+
+    if(gc.currentStack == NULL){
+        if(gc.stack_top_hint) \
+            scanMainStack(sp);
+    }
+    else{
+        scanStackExtent(gc.currentStack, sp);
+        scanSuspendedStack(&gc.mainStack);
+    }
+
+    for(GCStack *stack = gc.stacks; stack != NULL; stack = stack->nextStack){
+        if(stack != gc.currentStack) \
+            scanSuspendedStack(stack);
     }
 }
 
 // Walks explicit root list and makes sure to mark anything that still exists
+// then does the same for the live part of the shadow stack and every word of the root ranges
 static void markFromExplicitRoots(){
-    // walk the declared roots
+    // walk the declared roots (the array is dense so every entry is a root)
     for(size_t r = 0; r < gc.rootsLen; r++){
-        if(gc.roots == NULL) \
-            break;
-        if(gc.roots[r] == NULL) \
-            continue;
-        
         // try to mark the pointers
         void **slot = gc.roots[r];
         markPtr(*slot);
     }
+
+    // walk the open root frames
+    for(size_t r = 0; r < gcShadowStack.top; r++){
+        markPtr(*gcShadowStack.slots[r]);
+    }
+
+    // scan the registered blocks in one linear pass each
+    for(size_t r = 0; r < gc.rootRangesLen; r++){
+        scanRangeConservative(gc.rootRanges[r].low, gc.rootRanges[r].high);
+    }
+}
+
+// Calls the embedder's root callback so it can report its roots through gcMarkRoot() and gcMarkRootRange()
+static void markFromRootCallback(){
+    if(gc.rootCallback == NULL) \
+        return;
+
+    gc.inRootCallback = true;
+    gc.rootCallback(gc.rootCallbackCtx);
+    gc.inRootCallback = false;
+}
+
+// Scans the bytes a region has handed out as roots
+static void regionScan(GCRegion *region){
+    for(Page *page = region->pages; page != NULL; page = page->nextPage){
+        scanRangeConservative((uintptr_t)page->block, (uintptr_t)page->block + regionPageUsed(region, page));
+    }
+}
+
+// Scans the bytes handed out by every open region so the GC objects they point to stay alive
+// permanent pages are only scanned once the app has declared them mutable
+static void markFromRegions(){
+    for(GCRegion *region = gc.book.regions; region != NULL; region = region->nextRegion){
+        regionScan(region);
+    }
+
+    if(gc.permanentMutable) \
+        regionScan(&gc.book.permanent);
 }
 
 // Compute base with mask & look up in index
@@ -702,9 +2197,9 @@ static Page *findPageContaining(void *p, uint32_t *outIdx){
     if(page == NULL) \
         return NULL;    // if it's not valid page
 
-    // get the offset in the page
-    uintptr_t off = (uintptr_t)p - (uintptr_t)page->block;
-    if(off >= BUFF_SIZE) \
+    // get the offset in the page's slot array (pointers into the color gap wrap around and are rejected)
+    uintptr_t off = (uintptr_t)p - (uintptr_t)page->slots;
+    if(off >= page->spanSize) \
         return NULL;    // if the offset is larger than the page size
 
     // get the index in the page
@@ -720,97 +2215,428 @@ static Page *findPageContaining(void *p, uint32_t *outIdx){
 }
 
 // Adds an item to a worklist so the GC can act on it durring sweep phase
+// the item is dropped (and markOverflow set) if the top chunk is full and the pool has no chunk left
 static void wlPush(Page *page, uint32_t idx){
-    // grow the worklist array
-    if(workLen == workCap){
-        // grow values
-        size_t newCap = workCap ? workCap * 2 : 128;
-        WorkItem *temp = realloc(worklist, newCap * sizeof(WorkItem));
+    // start a new chunk from the pool
+    if(markTop == NULL || markTop->len == MARK_CHUNK_ITEMS){
+        if(markPool == NULL){
+            markOverflow = true;
+            markOverflowed = true;
+            return;
+        }
 
-        if(temp == NULL){
-            perror("[FATAL]: Could not allocate worklist.");
-            gcDestroy();
+        MarkChunk *chunk = markPool;
+        markPool = chunk->prev;
+        chunk->prev = markTop;
+        chunk->len = 0;
+        markTop = chunk;
+    }
 
-            exit(56);
-        }
+    // add the workitem to the top chunk
+    markTop->items[markTop->len].page = page;
+    markTop->items[markTop->len].idx = idx;
+    markTop->len++;
+}
 
-        // update values
-        worklist = temp;
-        workCap = newCap;
+// Pops the newest item off the worklist into *out, returns false once it is empty
+// emptied chunks go back to the pool
+static bool wlPop(WorkItem *out){
+    while(markTop && markTop->len == 0){
+        MarkChunk *chunk = markTop;
+        markTop = chunk->prev;
+        chunk->prev = markPool;
+        markPool = chunk;
     }
 
-    // add the workitem to the lisl
-    worklist[workLen].page = page;
-    worklist[workLen].idx = idx;
-    workLen++;
+    if(markTop == NULL) \
+        return false;
+
+    markTop->len--;
+    *out = markTop->items[markTop->len];
+    return true;
+}
+
+// Makes `count` more mark stack chunks and pools them
+// returns false if any could not be made, which only fails init, after a collection the mark stack just stays smaller
+static bool markChunksAdd(size_t count){
+    for(size_t i = 0; i < count; i++){
+        MarkChunk *chunk = malloc(sizeof(MarkChunk));
+        if(chunk == NULL) \
+            return false;
+
+        chunk->prev = markPool;
+        chunk->len = 0;
+        markPool = chunk;
+        markChunks++;
+    }
+
+    return true;
+}
+
+// Frees every mark stack chunk
+static void markChunksFree(){
+    while(markTop){
+        MarkChunk *prev = markTop->prev;
+        free(markTop);
+        markTop = prev;
+    }
+    while(markPool){
+        MarkChunk *prev = markPool->prev;
+        free(markPool);
+        markPool = prev;
+    }
+    markChunks = 0;
+    markOverflow = false;
+    markOverflowed = false;
 }
 
 // Attempts to mark a slot managed by GC based on given page and index
 static int slotMark(Page *page, uint32_t idx){
     // get markBit and bitmask for the index
-    uint8_t *mb = &page->markBits[bitByte(idx)];
-    uint8_t m = bitMask(idx);
+    uint64_t *mb = &page->markBits[bitWord(idx)];
+    uint64_t m = bitMask(idx);
+
+    if(markedBits(*mb) & m){
+        return 0;   // already marked
+    }
+    (*mb) ^= m; // flip to the current epoch's meaning of marked
+
+    return 1;
+}
+
+// Blacklists a free slot (or the free Immix line) a scanned word pointed into (Boehm style) so it is not handed out while that word could make it look alive
+// the blacklist only lasts until the next collection, which blacklists the slot again if the word is still there
+static void pageBlacklist(Page *page, uint32_t idx){
+    // drop what an older collection blacklisted, the bits are shared with other page kinds so they start out cleared on the first hit
+    if(page->blackEpoch != gc.markEpoch){
+        page->blackEpoch = gc.markEpoch;
+        page->blackCount = 0;
+    }
+    if(page->blackCount == 0){
+        if(page->kind == PAGE_IMMIX) \
+            memset(page->blackLines, 0, sizeof(page->blackLines));
+        else
+            memset(page->blackBits, 0, bitWords(page->nslots) * sizeof(uint64_t));
+    }
+
+    // Immix pages blacklist the whole line so the bump allocator skips it after the sweep
+    // a line a live object already marked is in use anyway (one marked later is dropped by sweepImmixPage())
+    uint64_t *bb = &page->blackBits[bitWord(idx)];
+    uint64_t bit = bitMask(idx);
+    if(page->kind == PAGE_IMMIX){
+        size_t line = (size_t)idx * IMMIX_GRANULE / IMMIX_LINE_SIZE;
+        if(page->lineBits[bitWord(line)] & bitMask(line)) \
+            return;
+        bb = &page->blackLines[bitWord(line)];
+        bit = bitMask(line);
+    }
+    if(*bb & bit) \
+        return;
+
+    *bb |= bit;
+    page->blackCount++;
+    gc.blacklisted++;
+}
+
+// Attempts to mark a slot on a page based off of a pointer
+// finds out whether page contains a pointer then makes an attempt to mark the correspondind slot in the page
+// a raw pointer to a movable object pins it for the collection since the pointer cannot be updated if it moved
+static void markPtr(void *ptr){
+    // get page based off of pointer
+    uint32_t idx = 0;
+    Page *page = findPageContaining(ptr, &idx);
+    if(page == NULL)
+        return;
+
+    // Immix objects can be found from any granule they cover
+    // a word pointing at free granules marks their line so the bump allocator skips it until the pointer goes away
+    if(page->kind == PAGE_IMMIX && !immixObjectStart(page, &idx)){
+        pageBlacklist(page, idx);
+        return;
+    }
+
+    // only consider allocated slots, free ones are blacklisted
+    if(!(page->inuseBits[bitWord(idx)] & bitMask(idx))){
+        if(page->kind == PAGE_CLASS) \
+            pageBlacklist(page, idx);
+        return;
+    }
+
+    if(page->kind == PAGE_MOVABLE) \
+        page->pinBits[bitWord(idx)] |= bitMask(idx);
+
+    // make sure last epoch's marks read as unmarked
+    pageSyncEpoch(page);
+
+    // mark it and add to worklist if it's not already marked
+    if(slotMark(page, idx)){
+        wlPush(page, idx);
+    }
+}
+
+// Marks the object behind every live handle without pinning it (unless gcPin() pinned it)
+static void markFromHandles(){
+    for(size_t h = 1; h < gc.handlesLen; h++){
+        HandleEntry *entry = &gc.handles[h];
+        if(entry->ptr == NULL) \
+            continue;
+
+        uint32_t idx = 0;
+        Page *page = findPageContaining(entry->ptr, &idx);
+        if(page == NULL) \
+            continue;
+
+        if(entry->pins) \
+            page->pinBits[bitWord(idx)] |= bitMask(idx);
+
+        pageSyncEpoch(page);
+        if(slotMark(page, idx)){
+            wlPush(page, idx);
+        }
+    }
+}
+
+// Clears the pin bits of every movable page before a collection finds the objects that cannot move
+static void movableClearPins(){
+    for(size_t c = 0; c < NUM_CLASSES; c++){
+        for(Page *page = gc.book.movablePages[c]; page != NULL; page = page->nextPage){
+            memset(page->pinBits, 0, bitWords(page->nslots) * sizeof(uint64_t));
+        }
+    }
+}
+
+// Scans the payload of a marked object for pointers to anything else the GC manages
+static void traceObject(Page *page, uint32_t idx){
+    // Immix objects mark the lines they sit on so sweeps know which lines are free
+    size_t nbytes = page->sizeClass;
+    if(page->kind == PAGE_IMMIX){
+        uint32_t last = immixObjectEnd(page, idx);
+        immixMarkLines(page, idx, last);
+        nbytes = (size_t)(last - idx + 1) * IMMIX_GRANULE;
+    }
+
+    // scan payload as words (attempt to mark anything inside the heap bounds)
+    scanWords((const uintptr_t *)slotBase(page, idx), nbytes / sizeof(uintptr_t));
+}
+
+// Traces every marked object on a list of slot pages
+static void markRescanList(Page *pages){
+    for(Page *page = pages; page != NULL; page = page->nextPage){
+        pageSyncEpoch(page);
+
+        size_t nwords = bitWords(page->nslots);
+        for(size_t w = 0; w < nwords; w++){
+            for(uint64_t live = page->inuseBits[w] & markedBits(page->markBits[w]); live; live &= live - 1){
+                traceObject(page, (uint32_t)(w * 64 + bitLowest(live)));
+            }
+        }
+    }
+}
+
+// Recovers from a mark stack overflow by tracing every marked object again (Boehm style)
+// the objects whose items were dropped are among them, anything they reach is pushed again or sets markOverflow for another round
+static void markRescan(){
+    markOverflow = false;
+
+    for(size_t c = 0; c < NUM_CLASSES; c++){
+        markRescanList(gc.book.classPages[c]);
+        markRescanList(gc.book.movablePages[c]);
+    }
+    for(GCPool *pool = gc.book.pools; pool != NULL; pool = pool->nextPool){
+        markRescanList(pool->pages);
+    }
+    markRescanList(gc.book.immixPages);
+}
+
+// Executes everything on the worklist
+// items go through a small FIFO, an object's payload is prefetched when it is popped and traced PREFETCH_DEPTH objects later so the load has landed by then
+static void traceWorklist(){
+    WorkItem fifo[PREFETCH_DEPTH];
+    size_t head = 0;
+    size_t count = 0;
+
+    // walk the worklist
+    while(true){
+        // top the FIFO up from the worklist
+        WorkItem item;
+        while(count < PREFETCH_DEPTH && wlPop(&item)){
+            PREFETCH(slotBase(item.page, item.idx));
+
+            fifo[(head + count) % PREFETCH_DEPTH] = item;
+            count++;
+        }
+
+        // once the worklist is drained, anything an overflow dropped is found again from the marked objects
+        if(count == 0){
+            if(!markOverflow) \
+                break;
+
+            markRescan();
+            continue;
+        }
+
+        // trace the oldest
+        item = fifo[head];
+        head = (head + 1) % PREFETCH_DEPTH;
+        count--;
+
+        traceObject(item.page, item.idx);
+    }
+}
+
+// ========
+// Sweeping
+// ========
+
+// Sweeps a single page a bitmap word (64 slots) at a time
+// dead = inuse & ~marked, so freeing is just dropping unmarked slots from the inuse bits without touching their memory
+// marks are never cleared, survivors already read as unmarked once the next collection flips the epoch
+// with freeMemory the OS pages inside dead slots of large classes are decommitted so one survivor does not keep the whole page resident
+static void sweepPage(Page *page){
+    size_t nwords = bitWords(page->nslots);
+    bool decommit = gc.freeMemory && page->sizeClass >= DECOMMIT_MIN_SIZE;
+    pageSyncEpoch(page);
+
+    // a page left empty is freed or cached whole by sweepPageList() so only pages that keep a live slot decommit their dead ones
+    // (these classes have few slots per page so checking first is cheap)
+    if(decommit){
+        decommit = false;
+        for(size_t w = 0; w < nwords && !decommit; w++){
+            decommit = (page->inuseBits[w] & markedBits(page->markBits[w])) != 0;
+        }
+    }
+
+    uint32_t live = 0;
+    size_t cursor = nwords;
+    for(size_t w = 0; w < nwords; w++){
+        uint64_t inuse = page->inuseBits[w];
+        uint64_t alive = inuse & markedBits(page->markBits[w]);
+
+        // words that are still fully live are left alone
+        if(alive != inuse){
+            page->inuseBits[w] = alive;
+
+            // give back the memory of dead slots
+            for(uint64_t dead = inuse & ~alive; decommit && dead; dead &= dead - 1){
+                slotDecommit(page, (uint32_t)(w * 64 + bitLowest(dead)));
+            }
+        }
+        live += bitPopcount(alive);
+
+        // remember the first word with room for the allocator
+        if(cursor == nwords && alive != bitWordMask(page->nslots, w)) \
+            cursor = w;
+    }
+    page->inuseCount = live;
+    page->allocCursor = (uint32_t)(cursor < nwords ? cursor : 0);
+    page->markEpoch = gc.markEpoch;
+}
+
+// Sweeps an Immix page, dropping unmarked objects from the inuse and end bits
+// free lines are whatever traceWorklist() left unmarked, less the lines it blacklisted
+static void sweepImmixPage(Page *page){
+    size_t nwords = bitWords(page->nslots);
+    pageSyncEpoch(page);
+
+    uint32_t live = 0;
+    for(size_t w = 0; w < nwords; w++){
+        uint64_t inuse = page->inuseBits[w];
+        uint64_t alive = inuse & markedBits(page->markBits[w]);
+
+        if(alive != inuse){
+            page->inuseBits[w] = alive;
+
+            for(uint64_t dead = inuse & ~alive; dead; dead &= dead - 1){
+                uint32_t last = immixObjectEnd(page, (uint32_t)(w * 64 + bitLowest(dead)));
+                page->endBits[bitWord(last)] &= ~bitMask(last);
+            }
+        }
+        live += bitPopcount(alive);
+    }
+    page->inuseCount = live;
+    page->allocCursor = 0;
+    page->markEpoch = gc.markEpoch;
+
+    // lines blacklisted before a live object marked them are in use, not blacklisted
+    uint32_t black = pageBlackCount(page);
+    if(black){
+        uint32_t kept = 0;
+        for(size_t w = 0; w < IMMIX_LINE_WORDS; w++){
+            page->blackLines[w] &= ~page->lineBits[w];
+            kept += bitPopcount(page->blackLines[w]);
+        }
+        page->blackCount = kept;
+        gc.blacklisted -= black - kept;
+    }
+}
 
-    if((*mb) & m){
-        return 0;   // already marked
+// Reorders a class (or pool) list by occupancy so allocation fills the fullest pages first and sparse pages get a chance to drain completely
+// pages are bucketed by inuseCount (keeping their order within a bucket) and full pages go last since they cannot take allocations
+// *cursor is moved back to the head of the list
+static void pagesSortByOccupancy(Page **pages, Page **cursor){
+    // bucket 0 is the fullest non full pages, the last bucket is full pages
+    Page *heads[OCCUPANCY_BUCKETS + 1];
+    Page **tails[OCCUPANCY_BUCKETS + 1];
+    for(size_t b = 0; b <= OCCUPANCY_BUCKETS; b++){
+        heads[b] = NULL;
+        tails[b] = &heads[b];
     }
-    (*mb) |= m;
 
-    return 1;
-}
+    for(Page *page = *pages; page != NULL; page = page->nextPage){
+        size_t b = OCCUPANCY_BUCKETS;
+        if(page->inuseCount < page->nslots) \
+            b = OCCUPANCY_BUCKETS - 1 - ((size_t)page->inuseCount * OCCUPANCY_BUCKETS / page->nslots);
 
-// Attempts to mark a slot on a page based off of a pointer
-// finds out whether page contains a pointer then makes an attempt to mark the correspondind slot in the page
-static void markPtr(void *ptr){
-    // get page based off of pointer
-    uint32_t idx = 0;
-    Page *page = findPageContaining(ptr, &idx);
-    if(page == NULL)
-        return;
+        *tails[b] = page;
+        tails[b] = &page->nextPage;
+    }
 
-    // only consider allocated slots
-    if(!(page->inuseBits[bitByte(idx)] & bitMask(idx)))
-        return;
+    // stitch the buckets back together
+    Page **link = pages;
+    for(size_t b = 0; b <= OCCUPANCY_BUCKETS; b++){
+        if(heads[b] == NULL) \
+            continue;
 
-    // mark it and add to worklist if it's not already marked
-    if(slotMark(page, idx)){
-        wlPush(page, idx);
+        *link = heads[b];
+        link = tails[b];
     }
+    *link = NULL;
+
+    *cursor = *pages;
 }
 
-// Executes everything on the worklist
-static void traceWorklist(){
-    // walk the worklist
-    while(workLen){
-        workLen--;
-
-        // get the page and index
-        Page *page = worklist[workLen].page;
-        uint32_t idx = worklist[workLen].idx;
-
-        // scan payload as words
-        uintptr_t *words = (uintptr_t *)slotBase(page, idx);
-        size_t nwords = page->sizeClass / sizeof(uintptr_t);
-        for(size_t i = 0; i < nwords; i++){
-            markPtr((void *)words[i]);  // attempt to mark anything
-        }
+// Moves a page that a sweep emptied to the emptyPages cache or frees it if freeing (reserved pages are always cached)
+static void pageRetireEmpty(Page *page){
+    if(gc.freeMemory && (size_t)gc.book.numPages > gc.reservedPages){
+        pageDestroyMeta(page);
+    }
+    else{
+        page->nextPage = gc.book.emptyPages;
+        gc.book.emptyPages = page;
     }
 }
 
-// ========
-// Sweeping
-// ========
+// Sweeps a list of slot pages, retiring the ones left empty and sorting the rest for the next round of allocations
+// empty pages gcReserve() formatted for the class are kept on the list so the reservation stays formatted
+static void sweepPageList(Page **pages, Page **cursor){
+    Page **link = pages;
+    while(*link){   // while there are pages left
+        Page *page = *link;
 
-// "frees" a slot and allows it to be reused in that page
-static void freeSlot(Page *page, uint32_t idx){
-    // push slot back to freelist
-    *slotNextPtr(page, idx) = page->freeHead;
-    page->freeHead = (int32_t)idx;
+        // free every unmarked slot on the page
+        sweepPage(page);
 
-    // clear inuse bit
-    page->inuseBits[bitByte(idx)] &= (uint8_t)~bitMask(idx);
-    if(page->inuseCount > 0)
-        page->inuseCount--;
+        if(page->inuseCount == 0 && !page->reserved){
+            // unlink from the list
+            *link = page->nextPage;
+            pageRetireEmpty(page);
+            continue;
+        }
+        link = &page->nextPage; // get next page
+    }
+
+    // fullest pages first for the next round of allocations
+    pagesSortByOccupancy(pages, cursor);
 }
 
 // Walks the list of pages and checks for any extra pointers to memory slots
@@ -819,40 +2645,125 @@ static void freeSlot(Page *page, uint32_t idx){
 static void sweepAllPages(){
     // for every class size
     for(size_t c = 0; c < NUM_CLASSES; c++){
-        Page **link = &gc.book.classPages[c];
-        while(*link){   // while there are pages left
-            Page *page = *link;
+        sweepPageList(&gc.book.classPages[c], &gc.book.classCursor[c]);
+    }
 
-            // walk all slots on the page
-            for(uint32_t i = 0; i < page->nslots; i++){
-                uint8_t ib = page->inuseBits[bitByte(i)] & bitMask(i);
-                uint8_t mb = page->markBits [bitByte(i)] & bitMask(i);
-
-                if(ib && !mb){
-                    freeSlot(page, i);
-                }
-                else if(mb){
-                    // clear mark for next cycle
-                    page->markBits[bitByte(i)] &= (uint8_t)~bitMask(i);
-                }
-            }
+    // so are movable pages (objects are evacuated after the sweep, see evacuateMovablePages())
+    for(size_t c = 0; c < NUM_CLASSES; c++){
+        sweepPageList(&gc.book.movablePages[c], &gc.book.movableCursor[c]);
+    }
 
-            if(page->inuseCount == 0){
-                // unlink from class list
+    // pool pages are swept the same as class pages
+    for(GCPool *pool = gc.book.pools; pool != NULL; pool = pool->nextPool){
+        sweepPageList(&pool->pages, &pool->cursor);
+    }
+
+    // Immix pages
+    Page **link = &gc.book.immixPages;
+    while(*link){
+        Page *page = *link;
+        sweepImmixPage(page);
+
+        if(page->inuseCount == 0){
+            *link = page->nextPage;
+            pageRetireEmpty(page);
+            continue;
+        }
+        link = &page->nextPage;
+    }
+
+    // start bump allocating from the free lines this sweep found
+    gc.book.immixCursor = gc.book.immixPages;
+    memset(&gc.immixBump, 0, sizeof(BumpRegion));
+    memset(&gc.immixOverflow, 0, sizeof(BumpRegion));
+}
+
+// ==========
+// Evacuation
+// ==========
+
+// Moves the unpinned objects off sparse movable pages into denser ones and updates their handles
+// pages at most 1/EVACUATE_DIVISOR full are emptied when there is more than one of them or the rest of the class has room for their objects
+// pages left empty go back to the empty page cache (or are freed), pages holding pinned objects go back into their list
+static void evacuateMovablePages(){
+    Page *sparse[NUM_CLASSES];
+    bool any = false;
+
+    // pull the sparse pages of each class out of its list
+    for(size_t c = 0; c < NUM_CLASSES; c++){
+        sparse[c] = NULL;
+        size_t count = 0;
+        size_t live = 0;
+        size_t room = 0;
+
+        Page **link = &gc.book.movablePages[c];
+        while(*link){
+            Page *page = *link;
+            if((size_t)page->inuseCount * EVACUATE_DIVISOR <= page->nslots){
                 *link = page->nextPage;
+                page->nextPage = sparse[c];
+                sparse[c] = page;
 
-                // move to emptyPages cache or free if freeing
-                if(gc.freeMemory){
-                    pageDestroyMeta(page);
-                }
-                else{
-                    page->nextPage = gc.book.emptyPages;
-                    gc.book.emptyPages = page;
-                }
+                count++;
+                live += page->inuseCount;
                 continue;
             }
-            link = &page->nextPage; // get next page
+            room += page->nslots - page->inuseCount;
+            link = &page->nextPage;
+        }
+
+        // a lone sparse page whose objects would need a new page is left alone
+        if(count == 1 && live > room){
+            sparse[c]->nextPage = gc.book.movablePages[c];
+            gc.book.movablePages[c] = sparse[c];
+            sparse[c] = NULL;
+        }
+        for(Page *page = sparse[c]; page != NULL; page = page->nextPage){
+            page->evacuating = 1;
+            any = true;
+        }
+        gc.book.movableCursor[c] = gc.book.movablePages[c];
+    }
+    if(!any) \
+        return;
+
+    // move every unpinned object a handle points to on an evacuating page
+    for(size_t h = 1; h < gc.handlesLen; h++){
+        HandleEntry *entry = &gc.handles[h];
+        if(entry->ptr == NULL) \
+            continue;
+
+        uint32_t idx = 0;
+        Page *page = findPageContaining(entry->ptr, &idx);
+        if(page == NULL || !page->evacuating || (page->pinBits[bitWord(idx)] & bitMask(idx))) \
+            continue;
+
+        int c = classForSize(page->sizeClass);
+        void *dst = takeFromPages(&gc.book.movablePages[c], &gc.book.movableCursor[c], page->sizeClass, CLASS_ALIGN, PAGE_MOVABLE);
+        memcpy(dst, entry->ptr, page->sizeClass);
+
+        page->inuseBits[bitWord(idx)] &= ~bitMask(idx);
+        page->inuseCount--;
+        entry->ptr = dst;
+    }
+
+    // put back what could not be emptied
+    for(size_t c = 0; c < NUM_CLASSES; c++){
+        for(Page *page = sparse[c]; page != NULL;){
+            Page *next = page->nextPage;
+            page->evacuating = 0;
+
+            if(page->inuseCount == 0){
+                pageRetireEmpty(page);
+            }
+            else{
+                page->nextPage = gc.book.movablePages[c];
+                gc.book.movablePages[c] = page;
+            }
+            page = next;
         }
+
+        pagesSortByOccupancy(&gc.book.movablePages[c], &gc.book.movableCursor[c]);
     }
 }
 
@@ -879,6 +2790,38 @@ void gcDebugPrintStats(){
             activePages++;
             liveBytes += (size_t)p->inuseCount * p->sizeClass;
         }
+        for (Page *p = gc.book.movablePages[i]; p != NULL; p = p->nextPage){
+            activePages++;
+            liveBytes += (size_t)p->inuseCount * p->sizeClass;
+        }
+    }
+
+    // pool pages
+    for (GCPool *pool = gc.book.pools; pool != NULL; pool = pool->nextPool){
+        for (Page *p = pool->pages; p != NULL; p = p->nextPage){
+            activePages++;
+            liveBytes += (size_t)p->inuseCount * p->sizeClass;
+        }
+    }
+
+    // region and permanent pages count the bytes they handed out
+    for (GCRegion *region = gc.book.regions; region != NULL; region = region->nextRegion){
+        for (Page *p = region->pages; p != NULL; p = p->nextPage){
+            activePages++;
+            liveBytes += regionPageUsed(region, p);
+        }
+    }
+    for (Page *p = gc.book.permanent.pages; p != NULL; p = p->nextPage){
+        activePages++;
+        liveBytes += regionPageUsed(&gc.book.permanent, p);
+    }
+
+    // Immix pages count the bytes of their marked lines
+    for (Page *p = gc.book.immixPages; p != NULL; p = p->nextPage){
+        activePages++;
+        for (size_t w = 0; w < IMMIX_LINE_WORDS; w++){
+            liveBytes += (size_t)bitPopcount(p->lineBits[w]) * IMMIX_LINE_SIZE;
+        }
     }
 
     // for every empty page
@@ -888,7 +2831,7 @@ void gcDebugPrintStats(){
     totalPages = activePages + emptyPages;
 
     // print the debug message
-    printf("[GC DEBUG] Pages: %zu (active %zu, empty %zu)  Live bytes: %zu  lastLiveBytes: %zu\n", totalPages, activePages, emptyPages, liveBytes, gc.lastLiveBytes);
+    printf("[GC DEBUG] Pages: %zu (active %zu, empty %zu)  Live bytes: %zu  lastLiveBytes: %zu  Decommitted bytes: %zu  Blacklisted: %zu\n", totalPages, activePages, emptyPages, liveBytes, gc.lastLiveBytes, gc.decommittedBytes, gc.blacklisted);
 }
 
 // =======================
@@ -898,14 +2841,66 @@ void gcDebugPrintStats(){
 // Initializes the GC and returns a bool to indicate whether initialization succeded
 // stack_top_hint is the address of a variable in main() ex:`&stackTop` used to scan the stack for memory addresses
 // freeMemory is a boolean used to togle between GC collection behavior
-// - if true the GC will free empty pages upon collect
+// - if true the GC will free empty pages upon collect and give back the OS pages of dead slots of 16KB and larger
 // - if false the GC will save empty pages in the arena and cached in a list for reuse
 bool gcInit(const void *stack_top_hint, bool freeMemory){
+    GCOptions options = {0};
+    options.freeMemory = freeMemory;
+
+    return gcInitWithOptions(stack_top_hint, &options);
+}
+
+// Initializes the GC the same as gcInit() but with extra options (see GCOptions)
+// passing NULL for options is the same as gcInit(stack_top_hint, false)
+bool gcInitWithOptions(const void *stack_top_hint, const GCOptions *options){
+    GCOptions defaults = {0};
+    if(options == NULL) \
+        options = &defaults;
+
     // store address of approximately where the stack top would be
     gc.stack_top_hint = stack_top_hint;
 
     // store whether or not we are going to be using the arena for everything
-    gc.freeMemory = freeMemory;
+    gc.freeMemory = options->freeMemory;
+
+    // huge pages need mmap, without it just use regular pages
+    gc.hugePages = options->hugePages && REMEM_HAVE_MMAP;
+
+    // permanent pages start out immutable
+    gc.permanentMutable = false;
+
+    // roots come from the stack scan unless the app reports them all itself
+    gc.stackScan = !options->noStackScan;
+
+    // start out on the main stack, gcInit() is called from deeper than stack_top_hint so its frame tells which way the stack grows
+    volatile int here;
+    memset(&gc.mainStack, 0, sizeof(GCStack));
+    gc.stacks = NULL;
+    gc.currentStack = NULL;
+    gc.stackGrowsDown = stack_top_hint == NULL || (uintptr_t)&here < (uintptr_t)stack_top_hint;
+    gc.rootCallback = NULL;
+    gc.rootCallbackCtx = NULL;
+    gc.inRootCallback = false;
+
+    // pick the allocation engine
+    gc.engine = options->engine;
+    memset(&gc.immixBump, 0, sizeof(BumpRegion));
+    memset(&gc.immixOverflow, 0, sizeof(BumpRegion));
+
+    // pick how scanned words are filtered
+    scanWordsSelect();
+
+    // reserve the mark stack up front so collections never allocate while marking
+    if(markChunks == 0 && !markChunksAdd(MARK_CHUNKS_RESERVED)){
+        markChunksFree();
+        return false;
+    }
+
+#if REMEM_HAVE_MMAP
+    long ps = sysconf(_SC_PAGESIZE);
+    if(ps > 0) \
+        osPageSize = (size_t)ps;
+#endif
 
     // start the arena
     gc.arena = arenaLocalInit();
@@ -916,19 +2911,114 @@ bool gcInit(const void *stack_top_hint, bool freeMemory){
     bookInit(&gc.book);
     pageIndexInit(128); // init page index
     
+    // set up handle table (entry 0 is never handed out)
+    gc.handles = NULL;
+    gc.handlesLen = 0;
+    gc.handlesCap = 0;
+    gc.handleFree = 0;
+
     // set up roots array
     gc.roots = NULL;
     gc.rootsLen = 0;
     gc.rootsCap = 0;
+    gc.rootIndex = NULL;
+    gc.rootIndexCap = 0;
+    gc.rootRanges = NULL;
+    gc.rootRangesLen = 0;
+    gc.rootRangesCap = 0;
+    gc.stackCheckpoint = 0;
+    gc.checkpointWords = NULL;
+    gc.checkpointLen = 0;
+    gc.checkpointCap = 0;
+#ifndef NDEBUG
+    gc.checkpointCopy = NULL;
+    gc.checkpointCopyLen = 0;
+#endif
+    gcShadowStack.top = 0;
+    if(options->reserveRoots) \
+        gcReserveRoots(options->reserveRoots);
 
     // initialize GC base autocollect data
+    gc.markEpoch = 0;
+    gc.nextColor = 0;
+    gc.decommittedBytes = 0;
+    gc.blacklisted = 0;
     gc.bytesSinceLastGC = 0;
     gc.lastLiveBytes = BUFF_SIZE;   // sane baseline
     gc.growthFactor = 1.5;  // collect when new bytes ~150% of last live
 
+    // reserve any pages asked for up front
+    gc.reservedPages = 0;
+    gcReserve(options->reserveBytes, options->reserveClassBytes, options->prefault);
+
     return true;
 }
 
+// Reserves pages up front so the cost of making them is taken now instead of on later allocations
+// bytes is rounded up to whole single unit pages that are kept empty and can be used by the Immix engine, regions and size classes whose pages fit in one unit
+// - classes of 64KB and up (with the default 1MB BUFF_SIZE) use pages spanning several units and can only be reserved through classBytes
+// classBytes is an optional (NULL) array of GC_NUM_CLASSES byte counts to reserve pages already formatted for each size class
+// - those pages stay on their class's list and keep its format even when a sweep leaves them empty
+// prefault touches the reserved memory now so first use does not page fault
+// - reserved pages are kept by the GC even when freeMemory is true
+void gcReserve(size_t bytes, const size_t *classBytes, bool prefault){
+    // work out how many pages (and BUFF_SIZE units for the index) are needed in total
+    size_t classPages[NUM_CLASSES] = {0};
+    size_t emptyPages = (bytes + BUFF_SIZE - 1) / BUFF_SIZE;
+    size_t total = emptyPages;
+    size_t units = emptyPages;
+    for(size_t c = 0; classBytes && c < NUM_CLASSES; c++){
+        size_t span = classSpanUnits((int)c) * BUFF_SIZE;
+        classPages[c] = (classBytes[c] + span - 1) / span;
+        total += classPages[c];
+        units += classPages[c] * classSpanUnits((int)c);
+    }
+    if(total == 0) \
+        return;
+
+    // size the page index and metadata slabs once instead of growing them as pages are made
+    pageIndexReserve(units);
+    if(!pageSlabReserve(total)){
+        perror("[FATAL]: Could not reserve Page metadata.");
+        gcDestroy();
+
+        exit(57);
+    }
+
+    // pages formatted for their class are pushed front into the class list, sweeps never retire them (see sweepPageList())
+    for(size_t c = 0; c < NUM_CLASSES; c++){
+        for(size_t i = 0; i < classPages[c]; i++){
+            Page *page = pageInitForClass((int)c);
+            page->reserved = 1;
+            if(prefault) \
+                osPrefault(page->block, page->spanSize);
+
+            page->nextPage = gc.book.classPages[c];
+            gc.book.classPages[c] = page;
+            gc.book.classCursor[c] = page;
+            gc.book.numPages++;
+        }
+    }
+
+    // class-less pages go into the empty page cache as single units (multi unit classes never take them, see pageTakeEmpty())
+    // formatted for the largest single unit class since it has the fewest bitmap words to clear
+    int emptyClass = 0;
+    while(emptyClass + 1 < (int)NUM_CLASSES && classSpanUnits(emptyClass + 1) == 1) \
+        emptyClass++;
+
+    for(size_t i = 0; i < emptyPages; i++){
+        Page *page = pageInitForClass(emptyClass);
+        if(prefault) \
+            osPrefault(page->block, BUFF_SIZE);
+
+        page->nextPage = gc.book.emptyPages;
+        gc.book.emptyPages = page;
+        gc.book.numPages++;
+    }
+
+    gc.reservedPages += total;
+}
+
 // Destroys the GC and arena it controlls, frees any associated memory
 void gcDestroy(){
     // if the GC was initialized (based on whether the arena is valid)
@@ -936,22 +3026,68 @@ void gcDestroy(){
         arenaLocalDestroy(gc.arena);
         gc.arena = NULL;
         gc.stack_top_hint = NULL;
+        gc.rootCallback = NULL;
+        gc.rootCallbackCtx = NULL;
         bookDestroy(&gc.book);
     }
 
+    // free the handle table
+    free(gc.handles);
+    gc.handles = NULL;
+    gc.handlesLen = 0;
+    gc.handlesCap = 0;
+    gc.handleFree = 0;
+
     // free the roots array
     free(gc.roots);
     gc.roots = NULL;
     gc.rootsLen = 0;
     gc.rootsCap = 0;
 
-    // free the worklist
-    free(worklist);
-    worklist = NULL;
-    workLen = 0;
-    workCap = 0;
+    free(gc.rootIndex);
+    gc.rootIndex = NULL;
+    gc.rootIndexCap = 0;
+
+    free(gc.rootRanges);
+    gc.rootRanges = NULL;
+    gc.rootRangesLen = 0;
+    gc.rootRangesCap = 0;
+
+    // free the stack checkpoint
+    free(gc.checkpointWords);
+    gc.checkpointWords = NULL;
+    gc.checkpointLen = 0;
+    gc.checkpointCap = 0;
+    gc.stackCheckpoint = 0;
+#ifndef NDEBUG
+    free(gc.checkpointCopy);
+    gc.checkpointCopy = NULL;
+    gc.checkpointCopyLen = 0;
+#endif
+
+    // free the registered stacks
+    while(gc.stacks){
+        GCStack *next = gc.stacks->nextStack;
+        free(gc.stacks);
+        gc.stacks = next;
+    }
+    gc.currentStack = NULL;
+    gc.mainStack.sp = 0;
+
+    // free the shadow stack
+    free(gcShadowStack.slots);
+    gcShadowStack.slots = NULL;
+    gcShadowStack.top = 0;
+    gcShadowStack.cap = 0;
+
+    // free the mark stack
+    markChunksFree();
 
     pageIndexFree();
+    pageSlabsDestroy();
+
+    // unmap huge page chunks last since pages are carved from them
+    hugeChunksDestroy();
 }
 
 // ==========================
@@ -960,15 +3096,32 @@ void gcDestroy(){
 
 // Manually trigger a collection from the GC to get more usable memory
 void gcCollect(){
+    // flip what a set mark bit means
+    gc.markEpoch++;
+
     // mark
-    workLen = 0; // reset worklist (capacity kept)
-    scanStackForRoots();
+    markOverflowed = false;
+    gc.blacklisted = 0;
+    immixClearLineMarks();
+    movableClearPins();
+    if(gc.stackScan) \
+        scanStackForRoots();
     markFromExplicitRoots();
+    markFromRootCallback();
+    markFromRegions();
+    markFromHandles();
     traceWorklist();
 
     // sweep
     sweepAllPages();
 
+    // double the mark stack's chunks for the next collection if this one overflowed (failing to is fine)
+    if(markOverflowed) \
+        markChunksAdd(markChunks);
+
+    // compact sparse movable pages
+    evacuateMovablePages();
+
     // update pressure
     gc.lastLiveBytes = recomputeLiveBytes();
     gc.bytesSinceLastGC = 0;
@@ -989,6 +3142,201 @@ void gcUnrootVariable(void **addr){
     }
 }
 
+// Reserves room for `count` explicit roots so rooting that many variables never grows the root table
+void gcReserveRoots(size_t count){
+    if(count) \
+        rootsReserve(count);
+}
+
+// Roots a block of memory so every pointer sized word in it is scanned for GC objects on each collection
+void gcAddRootRange(const void *base, size_t len){
+    if(base && len) \
+        addRootRange((uintptr_t)base, (uintptr_t)base + len);
+}
+
+// Unroots a block of memory rooted by gcAddRootRange()
+void gcRemoveRootRange(const void *base){
+    if(!base || !removeRootRange((uintptr_t)base)){
+        fprintf(stderr, "Could not find root range at address %p to remove.\n", base);
+    }
+}
+
+// Grows the shadow stack so n more roots fit and returns its top (used by GC_FRAME_BEGIN())
+size_t gcFrameGrow(size_t n){
+    size_t want = gcShadowStack.top + n;
+    if(want > gcShadowStack.cap){
+        size_t newCap = gcShadowStack.cap ? gcShadowStack.cap : 64;
+        while(newCap < want) \
+            newCap *= 2;
+
+        void ***temp = realloc(gcShadowStack.slots, newCap * sizeof(void **));
+        if(temp == NULL){
+            perror("[FATAL]: Could not grow GC shadow stack.");
+            gcDestroy();
+
+            exit(62);
+        }
+        gcShadowStack.slots = temp;
+        gcShadowStack.cap = newCap;
+    }
+
+    return gcShadowStack.top;
+}
+
+// Sets a function the GC calls during every collection to report roots it cannot find on its own, NULL removes it
+// - the callback reports roots with gcMarkRoot() and gcMarkRootRange() and must not allocate or collect
+void gcSetRootCallback(GCRootCallback callback, void *ctx){
+    gc.rootCallback = callback;
+    gc.rootCallbackCtx = ctx;
+}
+
+// Marks the object a pointer points into (or does nothing if the GC does not manage it)
+// - only has an effect when called from the root callback
+void gcMarkRoot(void *ptr){
+    if(gc.inRootCallback) \
+        markPtr(ptr);
+}
+
+// Marks every object pointed to by a pointer sized word in [base, base + len)
+// - only has an effect when called from the root callback
+void gcMarkRootRange(const void *base, size_t len){
+    if(gc.inRootCallback && base) \
+        scanRangeConservative((uintptr_t)base, (uintptr_t)base + len);
+}
+
+// Finds where a checkpoint taken from the frame holding frame_hint starts, everything between it and the stack's top is snapshotted
+// the calling frame has to be left to the live scan since its locals keep changing, so the boundary is pushed past the caller's frame record and the frame record it links to
+// those are only used when they look like frames between the caller and the top (frame pointers may be omitted), and never less than CHECKPOINT_FRAME_SLACK bytes past frame_hint
+// the furthest candidate wins, scanning too much live is only slower while snapshotting a live frame loses objects
+static uintptr_t stackCheckpointBoundary(uintptr_t hint, uintptr_t here, uintptr_t callerFrame, uintptr_t top){
+    if(hint > top) \
+        return hint - CHECKPOINT_FRAME_SLACK > top && hint > CHECKPOINT_FRAME_SLACK ? ALIGN_DOWN(hint - CHECKPOINT_FRAME_SLACK, sizeof(uintptr_t)) : top;
+
+    uintptr_t mark = top - hint > CHECKPOINT_FRAME_SLACK ? hint + CHECKPOINT_FRAME_SLACK : top;
+
+    // the caller's frame record (saved frame pointer then return address) sits at the end of its frame on most ABIs
+    if(callerFrame > here && callerFrame < top && callerFrame % sizeof(uintptr_t) == 0){
+        if(callerFrame + 2 * sizeof(uintptr_t) > mark) \
+            mark = callerFrame + 2 * sizeof(uintptr_t);
+
+        // the frame record it links to belongs to an older frame so it is past the caller's frame whatever the layout
+        uintptr_t olderFrame = *(const uintptr_t *)callerFrame;
+        if(olderFrame > callerFrame && olderFrame < top && olderFrame % sizeof(uintptr_t) == 0 && olderFrame > mark) \
+            mark = olderFrame;
+    }
+
+    mark = ALIGN_UP(mark, sizeof(uintptr_t));
+
+    return mark < top ? mark : top;
+}
+
+// Marks the frames older than the one calling it as unchanging so collections stop rescanning them
+// frame_hint is an address in the calling frame ex:`&checkpoint` (GC_STACK_CHECKPOINT_BEGIN() passes the frame's address)
+// - the calling frame and everything newer is still scanned on every collection
+// - the words in the older frames that point into GC pages are kept now and marked from on every collection instead
+// - those frames must not be changed to point at newer objects while the checkpoint is set (root those with GC_MARK), debug builds abort when they are
+// - gcStackCheckpointClear() must be called before the calling frame returns, frames that later reuse that stack are not scanned while the checkpoint is set
+// - calling it again replaces the checkpoint, GC_STACK_CHECKPOINT_BEGIN() and GC_STACK_CHECKPOINT_END() pair the calls in a scope
+// - only the main stack can be checkpointed
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((noinline))
+#endif
+void gcStackCheckpoint(const void *frame_hint){
+    volatile char here;
+    uintptr_t top = (uintptr_t)gc.stack_top_hint;
+    if(frame_hint == NULL || top == 0 || gc.currentStack){
+        stackCheckpointClear();
+        return;
+    }
+
+    // this function is never inlined so the frame it returns to is the caller's
+    uintptr_t callerFrame = 0;
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wframe-address"
+    callerFrame = (uintptr_t)__builtin_frame_address(1);
+#pragma GCC diagnostic pop
+#endif
+    uintptr_t mark = stackCheckpointBoundary((uintptr_t)frame_hint, (uintptr_t)&here, callerFrame, top);
+
+    // capture the frames between the checkpoint and the stack's top (whichever way the stack grows)
+    if(mark < top) \
+        stackCheckpointCapture(mark, top);
+    else \
+        stackCheckpointCapture(top, mark);
+    gc.stackCheckpoint = mark;
+}
+
+// Drops the stack checkpoint so collections scan the whole stack again
+void gcStackCheckpointClear(){
+    stackCheckpointClear();
+}
+
+// Registers a fiber or coroutine stack spanning [low, high) so collections scan it and returns a handle to it (NULL if the bounds are invalid)
+// ctx is an optional (NULL) saved register context of the fiber (ucontext_t, jmp_buf...) that is scanned along with the stack while it is suspended
+// - only the part of a suspended stack in use when gcSwitchStack() switched away from it is scanned
+GCStack *gcRegisterStack(const void *low, const void *high, const void *ctx, size_t ctxLen){
+    if(low == NULL || (uintptr_t)low >= (uintptr_t)high) \
+        return NULL;
+
+    GCStack *stack = calloc(1, sizeof(GCStack));
+    if(stack == NULL){
+        perror("[FATAL]: Could not allocate GC stack.");
+        gcDestroy();
+
+        exit(65);
+    }
+
+    stack->low = (uintptr_t)low;
+    stack->high = (uintptr_t)high;
+    stack->ctx = ctx;
+    stack->ctxLen = ctx ? ctxLen : 0;
+
+    stack->nextStack = gc.stacks;
+    gc.stacks = stack;
+
+    return stack;
+}
+
+// Unregisters a stack so collections stop scanning it (the running stack cannot be unregistered)
+void gcUnregisterStack(GCStack *stack){
+    if(stack == NULL || stack == gc.currentStack){
+        fprintf(stderr, "Could not unregister stack %p.\n", (void*)stack);
+        return;
+    }
+
+    // unlink from the registered stacks
+    GCStack **link = &gc.stacks;
+    while(*link && *link != stack) \
+        link = &(*link)->nextStack;
+    if(*link == NULL){
+        fprintf(stderr, "Could not unregister stack %p.\n", (void*)stack);
+        return;
+    }
+    *link = stack->nextStack;
+
+    free(stack);
+}
+
+// Tells the GC the running stack is about to be suspended for `to` (NULL for the main stack)
+// call it right before switching, it records how much of the suspended stack is in use and the registers it holds
+void gcSwitchStack(GCStack *to){
+    volatile int here;
+    GCStack *from = gc.currentStack ? gc.currentStack : &gc.mainStack;
+
+    // spill the registers of the stack being suspended where collections can scan them
+    setjmp(from->regs);
+    from->sp = ALIGN_DOWN((uintptr_t)&here, sizeof(uintptr_t));
+
+    gc.currentStack = to;
+}
+
+// Turns the conservative stack scan on or off
+// - with it off only explicit roots, root frames, root ranges, open regions, handles and the root callback keep objects alive
+void gcSetStackScan(bool enabled){
+    gc.stackScan = enabled;
+}
+
 // =====
 // Alloc
 // =====
@@ -996,6 +3344,10 @@ void gcUnrootVariable(void **addr){
 // Allocates a `size` block of memory and returns a pointer to the base of it
 // - any blocks to large to fit into GC pages will be allocated to an underlying arena these blocks will not be freed until the GC is destroyed
 void *gcAlloc(size_t size){
+    // the Immix engine bump allocates everything but the largest objects
+    if(gc.engine == GC_ENGINE_IMMIX && size <= IMMIX_MAX_OBJECT) \
+        return immixAlloc(size);
+
     int classIndex = classForSize(size);
     if(classIndex < 0){
         // large objects are allocated from the arena directly (not GC-managed)
@@ -1032,3 +3384,212 @@ void *gcAlloc(size_t size){
 
     return ptr; // exit giving pointer to slot in page in arena
 }
+
+// =====
+// Pools
+// =====
+
+// Creates a pool of slots of exactly objSize bytes (rounded up to align and to at least 16 bytes) and returns a handle to it
+// align must be a power of two and is raised to at least pointer alignment so stored pointers can be found
+// returns NULL if the arguments are invalid or objSize is larger than the largest size class
+// - pools live until gcDestroy()
+GCPool *gcPoolCreate(size_t objSize, size_t align){
+    if(align < alignof(void *)) \
+        align = alignof(void *);
+    if((align & (align - 1)) != 0) \
+        return NULL;
+
+    size_t slotSize = ALIGN_UP(objSize ? objSize : 1, align);
+    if(slotSize > sizeClasses[NUM_CLASSES - 1]) \
+        return NULL;
+
+    // page bitmaps only have room for slots of the smallest class
+    if(slotSize < sizeClasses[0]) \
+        slotSize = sizeClasses[0];
+
+    GCPool *pool = malloc(sizeof(GCPool));
+    if(pool == NULL){
+        perror("[FATAL]: Could not allocate GC pool.");
+        gcDestroy();
+
+        exit(58);
+    }
+
+    pool->slotSize = slotSize;
+    pool->align = align;
+    pool->pages = NULL;
+    pool->cursor = NULL;
+
+    pool->nextPool = gc.book.pools;
+    gc.book.pools = pool;
+
+    return pool;
+}
+
+// Allocates one slot from a pool and returns a pointer to the base of it
+// - skips the size class lookup of gcAlloc(), the slot is collected like any other
+void *gcPoolAlloc(GCPool *pool){
+    return allocFromPages(&pool->pages, &pool->cursor, pool->slotSize, pool->align);
+}
+
+// =======
+// Regions
+// =======
+
+// Opens a region that objects which die together can be allocated into with gcAllocIn()
+// - region objects are bump allocated on pages of their own and are never marked or swept
+// - while the region is open everything allocated in it is scanned as a root so GC objects it points to stay alive
+GCRegion *gcRegionBegin(){
+    GCRegion *region = malloc(sizeof(GCRegion));
+    if(region == NULL){
+        perror("[FATAL]: Could not allocate GC region.");
+        gcDestroy();
+
+        exit(59);
+    }
+
+    region->pages = NULL;
+    region->cursor = 0;
+    region->limit = 0;
+
+    region->nextRegion = gc.book.regions;
+    gc.book.regions = region;
+
+    return region;
+}
+
+// Allocates a `size` block of memory in a region and returns a pointer to the base of it
+// passing NULL for region is the same as gcAlloc(size)
+void *gcAllocIn(GCRegion *region, size_t size){
+    if(region == NULL) \
+        return gcAlloc(size);
+
+    return regionAlloc(region, size, PAGE_REGION);
+}
+
+// Ends a region and releases all of its pages at once without sweeping them
+// - anything allocated in the region must no longer be used
+void gcRegionEnd(GCRegion *region){
+    if(region == NULL) \
+        return;
+
+    // unlink from the open regions
+    GCRegion **link = &gc.book.regions;
+    while(*link && *link != region) \
+        link = &(*link)->nextRegion;
+    if(*link) \
+        *link = region->nextRegion;
+
+    // pages go back to the empty page cache (or are freed when freeing) like pages a sweep emptied
+    // spans made for a single large object are always freed, the cache only reuses them for that exact span so they would stay until gcDestroy()
+    for(Page *page = region->pages; page != NULL;){
+        Page *next = page->nextPage;
+        if(page->spanSize > BUFF_SIZE) \
+            pageDestroyMeta(page);
+        else
+            pageRetireEmpty(page);
+        page = next;
+    }
+
+    free(region);
+}
+
+// ===============
+// Permanent Space
+// ===============
+
+// Allocates a `size` block of memory that lives until gcDestroy() and returns a pointer to the base of it
+// - permanent pages are never swept and pointers into them count as already marked so collections skip them entirely
+// - they are not scanned for pointers to GC objects unless declared mutable with gcSetPermanentMutable()
+void *gcAllocPermanent(size_t size){
+    return regionAlloc(&gc.book.permanent, size, PAGE_PERMANENT);
+}
+
+// Declares whether permanent objects may point to GC objects that nothing else keeps alive
+// - while true every collection scans the permanent pages as roots, while false (the default) they are skipped
+void gcSetPermanentMutable(bool isMutable){
+    gc.permanentMutable = isMutable;
+}
+
+// ===============
+// Movable Objects
+// ===============
+
+// Allocates a `size` block of memory the GC may move and returns a handle to it (0 if size is larger than the largest size class)
+// - the handle keeps the object alive until gcReleaseHandle()
+// - use gcHandleGet() or gcPin() to get its current address
+gc_handle_t gcAllocMovable(size_t size){
+    int classIndex = classForSize(size);
+    if(classIndex < 0) \
+        return 0;
+
+    // same as allocFromPages() but onto movable pages
+    maybeCollectOnPressure(sizeClasses[classIndex]);
+    gc.bytesSinceLastGC += sizeClasses[classIndex];
+    void *ptr = takeFromPages(&gc.book.movablePages[classIndex], &gc.book.movableCursor[classIndex], sizeClasses[classIndex], CLASS_ALIGN, PAGE_MOVABLE);
+
+    // reuse a free entry or grow the table
+    uint32_t h = gc.handleFree;
+    if(h != 0){
+        gc.handleFree = gc.handles[h].nextFree;
+    }
+    else{
+        if(gc.handlesLen == 0) \
+            gc.handlesLen = 1;  // skip entry 0
+
+        if(gc.handlesLen >= gc.handlesCap){
+            size_t newCap = gc.handlesCap ? gc.handlesCap * 2 : 64;
+            HandleEntry *temp = realloc(gc.handles, newCap * sizeof(HandleEntry));
+            if(temp == NULL){
+                perror("[FATAL]: Could not allocate GC handle table.");
+                gcDestroy();
+
+                exit(60);
+            }
+            gc.handles = temp;
+            gc.handlesCap = newCap;
+        }
+        h = (uint32_t)gc.handlesLen++;
+    }
+
+    gc.handles[h].ptr = ptr;
+    gc.handles[h].pins = 0;
+    gc.handles[h].nextFree = 0;
+
+    return h;
+}
+
+// Returns the current address of a movable object
+// - the address is only good until the next allocation or collection, unless the object is pinned
+// - a raw pointer still on the stack or in another GC object when a collection runs pins the object for that collection
+void *gcHandleGet(gc_handle_t handle){
+    return handle && handle < gc.handlesLen ? gc.handles[handle].ptr : NULL;
+}
+
+// Pins a movable object so collections will not move it and returns its address
+// - pins nest, every gcPin() needs a matching gcUnpin()
+void *gcPin(gc_handle_t handle){
+    if(handle == 0 || handle >= gc.handlesLen || gc.handles[handle].ptr == NULL) \
+        return NULL;
+
+    gc.handles[handle].pins++;
+
+    return gc.handles[handle].ptr;
+}
+
+// Undoes one gcPin() so the object can be moved again once it is no longer pinned
+void gcUnpin(gc_handle_t handle){
+    if(handle && handle < gc.handlesLen && gc.handles[handle].pins) \
+        gc.handles[handle].pins--;
+}
+
+// Releases a handle, the object is freed by a later collection once nothing else points to it
+void gcReleaseHandle(gc_handle_t handle){
+    if(handle == 0 || handle >= gc.handlesLen || gc.handles[handle].ptr == NULL) \
+        return;
+
+    gc.handles[handle].ptr = NULL;
+    gc.handles[handle].pins = 0;
+    gc.handles[handle].nextFree = gc.handleFree;
+    gc.handleFree = (uint32_t)handle;
+}
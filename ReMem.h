@@ -14,6 +14,103 @@
 #define GC_UNMARK(var) \
     gcUnrootVariable((void**)&(var))
 
+// Shadow stack of function scoped roots pushed and popped by the GC_FRAME macros
+// - slots holds the addresses of rooted variables, everything below top is scanned by every collection
+typedef struct GCShadowStack{
+    void ***slots;
+    size_t top;
+    size_t cap;
+} GCShadowStack;
+extern GCShadowStack gcShadowStack;
+
+// Opens a root frame with room for n GC_FRAME_ROOT()s in the current scope (one frame per scope)
+// pushing and popping roots just moves the shadow stack's top, it only calls into the GC when the stack has to grow
+#define GC_FRAME_BEGIN(n) \
+    size_t gcFrameBase_ = (gcShadowStack.top + (size_t)(n) <= gcShadowStack.cap ? gcShadowStack.top : gcFrameGrow(n))
+// Roots a variable until the frame ends
+// arguement is a regular variable (no pointer or address)
+#define GC_FRAME_ROOT(var) \
+    (gcShadowStack.slots[gcShadowStack.top++] = (void**)&(var))
+// Closes the frame opened in the current scope and unroots everything rooted in it
+// must run before the scope is left (a return or longjmp past it leaves the variables rooted)
+#define GC_FRAME_END() \
+    (gcShadowStack.top = gcFrameBase_)
+
+// Opens a stack checkpoint for the frames older than the current one (see gcStackCheckpoint()), one per scope
+// they stop being rescanned until GC_STACK_CHECKPOINT_END(), the current frame is still scanned on every collection
+// the frame address keeps a frame pointer in the calling function so gcStackCheckpoint() can find where its frame ends
+#if defined(__GNUC__) || defined(__clang__)
+#define GC_STACK_CHECKPOINT_BEGIN() \
+    volatile char gcCheckpointFrame_ = (gcStackCheckpoint(__builtin_frame_address(0)), 0)
+#else
+#define GC_STACK_CHECKPOINT_BEGIN() \
+    volatile char gcCheckpointFrame_ = (gcStackCheckpoint((const void *)&gcCheckpointFrame_), 0)
+#endif
+// Closes the checkpoint opened in the current scope
+// must run before the scope is left (a return or longjmp past it leaves collections skipping whatever frames replace these)
+#define GC_STACK_CHECKPOINT_END() \
+    ((void)gcCheckpointFrame_, gcStackCheckpointClear())
+
+// Number of size classes the GC breaks pages into (16, 32, 64 ... 262144 bytes)
+// used for per class hints like in gcReserve()
+#define GC_NUM_CLASSES 15
+
+// Allocation engines the GC can be built around (see GCOptions)
+typedef enum GCEngine{
+    // objects are rounded up to a size class and handed a slot on a page of that class
+    GC_ENGINE_SIZE_CLASSES,
+
+    // Immix style mark-region: pages are split into 128 byte lines and objects of any size are bump allocated into runs of free lines
+    // - objects are only rounded up to 16 bytes and space is recovered a line at a time
+    // - objects larger than a quarter of a page still use size classes
+    GC_ENGINE_IMMIX
+} GCEngine;
+
+// Function the GC calls during every collection to report roots with gcMarkRoot() and gcMarkRootRange() (see gcSetRootCallback())
+// ctx is the pointer given to gcSetRootCallback()
+typedef void (*GCRootCallback)(void *ctx);
+
+// Options used to configure the GC on initialization (see gcInitWithOptions())
+// any field left zeroed keeps the same behavior as gcInit()
+typedef struct GCOptions{
+    // same as the freeMemory arguement of gcInit()
+    bool freeMemory;
+
+    // back GC pages with 2MB huge pages to cut down on TLB misses for large heaps
+    // - uses MAP_HUGETLB if huge pages are reserved, otherwise aligns pages to 2MB and uses madvise(MADV_HUGEPAGE)
+    // - falls back to regular pages if the platform has neither
+    bool hugePages;
+
+    // reserve pages during init, same as calling gcReserve(reserveBytes, reserveClassBytes, prefault) right after gcInit()
+    size_t reserveBytes;
+    size_t reserveClassBytes[GC_NUM_CLASSES];
+    bool prefault;
+
+    // allocation engine used for gcAlloc() (size classes by default)
+    GCEngine engine;
+
+    // explicit roots to make room for during init, same as calling gcReserveRoots(reserveRoots) right after gcInit()
+    size_t reserveRoots;
+
+    // turn off the conservative stack scan, same as calling gcSetStackScan(false) right after gcInit()
+    // - for embedders that report every root themselves (explicit roots, root frames, root ranges or the root callback)
+    // - stack_top_hint may then be NULL
+    bool noStackScan;
+} GCOptions;
+
+// Pool of exact size slots made by gcPoolCreate() and allocated from with gcPoolAlloc()
+typedef struct GCPool GCPool;
+
+// Region of objects that die together made by gcRegionBegin() and released by gcRegionEnd()
+typedef struct GCRegion GCRegion;
+
+// Fiber or coroutine stack registered with gcRegisterStack()
+typedef struct GCStack GCStack;
+
+// Handle to a movable object made by gcAllocMovable() (0 is never a valid handle)
+// collections may move the object to compact sparse pages so its address has to be looked up through the handle
+typedef size_t gc_handle_t;
+
 // Will print basic info about the internal state of the GC
 // prints current inuse pageCount empty pageCount last bytes...
 void gcDebugPrintStats();
@@ -21,10 +118,23 @@ void gcDebugPrintStats();
 // Initializes the GC and returns a bool to indicate whether initialization succeded
 // stack_top_hint is the address of a variable in main() ex:`&stackTop` used to scan the stack for memory addresses
 // freeMemory is a boolean used to togle between GC collection behavior
-// - if true the GC will free empty pages upon collect
+// - if true the GC will free empty pages upon collect and give back the OS pages of dead slots of 16KB and larger
 // - if false the GC will save empty pages in the arena and cached in a list for reuse
 bool gcInit(const void *stack_top_hint, bool freeMemory);
 
+// Initializes the GC the same as gcInit() but with extra options (see GCOptions)
+// passing NULL for options is the same as gcInit(stack_top_hint, false)
+bool gcInitWithOptions(const void *stack_top_hint, const GCOptions *options);
+
+// Reserves pages up front so the cost of making them is taken now instead of on later allocations
+// bytes is rounded up to whole single unit pages that are kept empty and can be used by the Immix engine, regions and size classes whose pages fit in one unit
+// - classes of 64KB and up (with the default 1MB BUFF_SIZE) use pages spanning several units and can only be reserved through classBytes
+// classBytes is an optional (NULL) array of GC_NUM_CLASSES byte counts to reserve pages already formatted for each size class
+// - those pages stay formatted for their class even when a sweep leaves them empty
+// prefault touches the reserved memory now so first use does not page fault
+// - reserved pages are kept by the GC even when freeMemory is true
+void gcReserve(size_t bytes, const size_t *classBytes, bool prefault);
+
 // Destroys the GC and arena it controlls, frees any associated memory
 void gcDestroy();
 
@@ -41,4 +151,111 @@ void gcRootVariable(void **addr);
 // Manually root a variable for safety so that the GC will then be able to free it on next collect
 void gcUnrootVariable(void **addr);
 
+// Reserves room for `count` explicit roots so rooting that many variables never grows the root table
+void gcReserveRoots(size_t count);
+
+// Roots a block of memory (like a malloc'd table or static array of GC pointers) with a single entry
+// - every pointer sized word in [base, base + len) is scanned for GC objects on each collection
+// - rooting a block at the same base again replaces its length
+void gcAddRootRange(const void *base, size_t len);
+
+// Unroots a block of memory rooted by gcAddRootRange(), base must be the same address it was rooted with
+void gcRemoveRootRange(const void *base);
+
+// Grows the shadow stack so n more roots fit and returns its top (used by GC_FRAME_BEGIN())
+size_t gcFrameGrow(size_t n);
+
+// Sets a function the GC calls during every collection to report roots it cannot find on its own, NULL removes it
+// - the callback reports roots with gcMarkRoot() and gcMarkRootRange() and must not allocate or collect
+void gcSetRootCallback(GCRootCallback callback, void *ctx);
+
+// Marks the object a pointer points into (or does nothing if the GC does not manage it)
+// - only has an effect when called from the root callback
+void gcMarkRoot(void *ptr);
+
+// Marks every object pointed to by a pointer sized word in [base, base + len)
+// - only has an effect when called from the root callback
+void gcMarkRootRange(const void *base, size_t len);
+
+// Marks the frames older than the one calling it as unchanging so collections stop rescanning them
+// frame_hint is an address in the calling frame ex:`&checkpoint` (GC_STACK_CHECKPOINT_BEGIN() passes the frame's address)
+// - the calling frame and everything newer is still scanned on every collection
+// - the words in the older frames that point into GC pages are kept now and marked from on every collection instead
+// - those frames must not be changed to point at newer objects while the checkpoint is set (root those with GC_MARK), debug builds abort when they are
+// - gcStackCheckpointClear() must be called before the calling frame returns, frames that later reuse that stack are not scanned while the checkpoint is set
+// - calling it again replaces the checkpoint, GC_STACK_CHECKPOINT_BEGIN() and GC_STACK_CHECKPOINT_END() pair the calls in a scope
+// - only the main stack can be checkpointed
+void gcStackCheckpoint(const void *frame_hint);
+
+// Drops the stack checkpoint so collections scan the whole stack again
+void gcStackCheckpointClear();
+
+// Registers a fiber or coroutine stack spanning [low, high) so collections scan it and returns a handle to it (NULL if the bounds are invalid)
+// ctx is an optional (NULL) saved register context of the fiber (ucontext_t, jmp_buf...) that is scanned along with the stack while it is suspended
+// - only the part of a suspended stack in use when gcSwitchStack() switched away from it is scanned
+GCStack *gcRegisterStack(const void *low, const void *high, const void *ctx, size_t ctxLen);
+
+// Unregisters a stack so collections stop scanning it (the running stack cannot be unregistered)
+void gcUnregisterStack(GCStack *stack);
+
+// Tells the GC the running stack is about to be suspended for `to` (NULL for the main stack)
+// call it right before switching, it records how much of the suspended stack is in use and the registers it holds
+void gcSwitchStack(GCStack *to);
+
+// Turns the conservative stack scan on or off (on by default)
+// - with it off only explicit roots, root frames, root ranges, open regions, handles and the root callback keep objects alive
+void gcSetStackScan(bool enabled);
+
+// Creates a pool of slots of exactly objSize bytes (rounded up to align and to at least 16 bytes) and returns a handle to it
+// align must be a power of two and is raised to at least pointer alignment so stored pointers can be found
+// returns NULL if the arguments are invalid or objSize is larger than the largest size class
+// - pools live until gcDestroy()
+GCPool *gcPoolCreate(size_t objSize, size_t align);
+
+// Allocates one slot from a pool and returns a pointer to the base of it
+// - skips the size class lookup of gcAlloc(), the slot is collected like any other
+void *gcPoolAlloc(GCPool *pool);
+
+// Opens a region that objects which die together can be allocated into with gcAllocIn()
+// - region objects are bump allocated on pages of their own and are never marked or swept
+// - while the region is open everything allocated in it is scanned as a root so GC objects it points to stay alive
+GCRegion *gcRegionBegin();
+
+// Allocates a `size` block of memory in a region and returns a pointer to the base of it
+// passing NULL for region is the same as gcAlloc(size)
+void *gcAllocIn(GCRegion *region, size_t size);
+
+// Ends a region and releases all of its pages at once without sweeping them
+// - anything allocated in the region must no longer be used
+void gcRegionEnd(GCRegion *region);
+
+// Allocates a `size` block of memory that lives until gcDestroy() and returns a pointer to the base of it
+// - permanent pages are never swept and pointers into them count as already marked so collections skip them entirely
+// - they are not scanned for pointers to GC objects unless declared mutable with gcSetPermanentMutable()
+void *gcAllocPermanent(size_t size);
+
+// Declares whether permanent objects may point to GC objects that nothing else keeps alive
+// - while true every collection scans the permanent pages as roots, while false (the default) they are skipped
+void gcSetPermanentMutable(bool isMutable);
+
+// Allocates a `size` block of memory the GC may move and returns a handle to it (0 if size is larger than the largest size class)
+// - the handle keeps the object alive until gcReleaseHandle()
+// - use gcHandleGet() or gcPin() to get its current address
+gc_handle_t gcAllocMovable(size_t size);
+
+// Returns the current address of a movable object
+// - the address is only good until the next allocation or collection, unless the object is pinned
+// - a raw pointer still on the stack or in another GC object when a collection runs pins the object for that collection
+void *gcHandleGet(gc_handle_t handle);
+
+// Pins a movable object so collections will not move it and returns its address
+// - pins nest, every gcPin() needs a matching gcUnpin()
+void *gcPin(gc_handle_t handle);
+
+// Undoes one gcPin() so the object can be moved again once it is no longer pinned
+void gcUnpin(gc_handle_t handle);
+
+// Releases a handle, the object is freed by a later collection once nothing else points to it
+void gcReleaseHandle(gc_handle_t handle);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,229 @@
+// ucontext.h (used by the fiber check) is only declared for XSI builds on macOS
+#if defined(__APPLE__)
+#define _XOPEN_SOURCE 600
+#define _DARWIN_C_SOURCE
+#endif
+
+// every check is an assert so this is never built with NDEBUG
+#undef NDEBUG
+
+#include "../ReMem.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ucontext.h>
+
+#define OBJ_SIZE 64
+#define OBJ_WORDS (OBJ_SIZE / sizeof(uint64_t))
+#define CHURN_OBJS 20000
+#define FIBER_STACK_SIZE (256 * 1024)
+
+// =======
+// helpers
+// =======
+
+// fill an object with a pattern derived from seed
+static void fill(uint64_t *obj, uint64_t seed){
+    for(size_t i=0;i<OBJ_WORDS;i++) obj[i] = seed * 0x9E3779B97F4A7C15ull + i;
+}
+
+// check an object still holds the pattern fill() wrote
+static bool intact(const uint64_t *obj, uint64_t seed){
+    for(size_t i=0;i<OBJ_WORDS;i++) if(obj[i] != seed * 0x9E3779B97F4A7C15ull + i) return false;
+    return true;
+}
+
+// allocate and overwrite enough garbage that anything freed by a collection gets reused and clobbered
+static void churn(void){
+    for(int i=0;i<CHURN_OBJS;i++) memset(gcAlloc(OBJ_SIZE), 0xEE, OBJ_SIZE);
+}
+
+// collect a few times with garbage in between
+static void collect(void){
+    for(int i=0;i<3;i++){ churn(); gcCollect(); }
+}
+
+// hide a pointer from the conservative scan
+static uintptr_t hide(void *p){ return (uintptr_t)p ^ 0x5A5A5A5Aul; }
+static void *unhide(uintptr_t h){ return (void *)(h ^ 0x5A5A5A5Aul); }
+
+// ======
+// checks
+// ======
+
+// an object reached only through a stack local survives
+static void check_stack_local(void){
+    uint64_t *volatile obj = gcAlloc(OBJ_SIZE);
+    fill(obj, 1);
+    collect();
+    assert(intact(obj, 1));
+}
+
+// explicit roots keep an object alive and unrooting one does not disturb the others (root index removal)
+static void check_explicit_roots(void){
+    static uint64_t *roots[64];
+    for(int i=0;i<64;i++){ roots[i] = gcAlloc(OBJ_SIZE); fill(roots[i], 100 + i); GC_MARK(roots[i]); }
+    for(int i=0;i<64;i+=2) GC_UNMARK(roots[i]);
+    for(int i=0;i<64;i+=2) roots[i] = NULL;
+    collect();
+    for(int i=1;i<64;i+=2){ assert(intact(roots[i], 100 + i)); GC_UNMARK(roots[i]); }
+}
+
+// objects reached only through a root range survive
+static void check_root_range(void){
+    uintptr_t *table = calloc(16, sizeof(uintptr_t));
+    assert(table);
+    for(int i=0;i<16;i++){ uint64_t *obj = gcAlloc(OBJ_SIZE); fill(obj, 200 + i); table[i] = (uintptr_t)obj; }
+    gcAddRootRange(table, 16 * sizeof(uintptr_t));
+    collect();
+    for(int i=0;i<16;i++) assert(intact((uint64_t *)table[i], 200 + i));
+    gcRemoveRootRange(table);
+    free(table);
+}
+
+// a movable object survives evacuation through its handle and a pinned one does not move
+static void check_handles(void){
+    enum { NH = 4000 };
+    static gc_handle_t hs[NH];
+    for(int i=0;i<NH;i++){ hs[i] = gcAllocMovable(OBJ_SIZE); fill(gcHandleGet(hs[i]), 300 + i); }
+    // leave the pages sparse so collections evacuate them
+    for(int i=0;i<NH;i++) if(i % 16){ gcReleaseHandle(hs[i]); hs[i] = 0; }
+    uint64_t *pinned = gcPin(hs[0]);
+    collect();
+    assert(gcHandleGet(hs[0]) == pinned);
+    gcUnpin(hs[0]);
+    for(int i=0;i<NH;i+=16){ assert(intact(gcHandleGet(hs[i]), 300 + i)); gcReleaseHandle(hs[i]); }
+}
+
+// objects allocated after a stack checkpoint in the checkpointing frame and below it survive
+static __attribute__((noinline)) void check_checkpoint_inner(int depth){
+    if(depth){ check_checkpoint_inner(depth - 1); return; }
+    GC_STACK_CHECKPOINT_BEGIN();
+    uint64_t *volatile obj = gcAlloc(OBJ_SIZE);
+    fill(obj, 400);
+    collect();
+    assert(intact(obj, 400));
+    GC_STACK_CHECKPOINT_END();
+}
+static void check_checkpoint(void){
+    uint64_t *volatile older = gcAlloc(OBJ_SIZE);
+    fill(older, 401);
+    check_checkpoint_inner(20);
+    collect();
+    assert(intact(older, 401));
+}
+
+// pool slots honour their alignment and survive like any other object
+static void check_pools(void){
+    GCPool *small = gcPoolCreate(8, 8);
+    GCPool *aligned = gcPoolCreate(72, 128);
+    assert(small && aligned);
+    uint64_t *volatile keep = NULL;
+    for(int i=0;i<200000;i++){
+        uint64_t *p = gcPoolAlloc(small);
+        *p = (uint64_t)(uintptr_t)keep;
+        keep = p;
+    }
+    uint64_t *volatile a = gcPoolAlloc(aligned);
+    assert(((uintptr_t)a & 127) == 0);
+    fill(a, 500);
+    collect();
+    assert(intact(a, 500));
+    size_t n = 0;
+    for(uint64_t *p = keep; p; p = (uint64_t *)(uintptr_t)*p) n++;
+    assert(n == 200000);
+}
+
+// state shared between the main stack and the fiber in the fiber check
+static ucontext_t fiber_main_ctx, fiber_ctx;
+static GCStack *fiber_stack;
+static bool fiber_ok;
+
+// an object reached only through a suspended fiber's stack survives collections run from the main stack
+static void fiber_entry(void){
+    uint64_t *volatile obj = gcAlloc(OBJ_SIZE);
+    fill(obj, 600);
+    gcSwitchStack(NULL);
+    swapcontext(&fiber_ctx, &fiber_main_ctx);
+    fiber_ok = intact(obj, 600);
+    gcSwitchStack(NULL);
+}
+static void check_fiber(void){
+    char *mem = malloc(FIBER_STACK_SIZE);
+    assert(mem);
+    getcontext(&fiber_ctx);
+    fiber_ctx.uc_stack.ss_sp = mem;
+    fiber_ctx.uc_stack.ss_size = FIBER_STACK_SIZE;
+    fiber_ctx.uc_link = &fiber_main_ctx;
+    makecontext(&fiber_ctx, fiber_entry, 0);
+    fiber_stack = gcRegisterStack(mem, mem + FIBER_STACK_SIZE, &fiber_ctx, sizeof(fiber_ctx));
+    assert(fiber_stack);
+
+    gcSwitchStack(fiber_stack);
+    swapcontext(&fiber_main_ctx, &fiber_ctx);
+    collect();
+    gcSwitchStack(fiber_stack);
+    swapcontext(&fiber_main_ctx, &fiber_ctx);
+    assert(fiber_ok);
+
+    gcUnregisterStack(fiber_stack);
+    free(mem);
+}
+
+// a word pointing into a dead slot blacklists it so it is not handed out again while the word is there
+static void check_blacklist(void){
+    static uintptr_t fake;
+    gcAddRootRange(&fake, sizeof(fake));
+    uintptr_t victim = hide(gcAlloc(OBJ_SIZE));
+    collect();
+    fake = (uintptr_t)unhide(victim) + 8;
+    gcCollect();
+    for(int i=0;i<CHURN_OBJS;i++) assert(hide(gcAlloc(OBJ_SIZE)) != victim);
+    fake = 0;
+    gcRemoveRootRange(&fake);
+}
+
+// ====
+// main
+// ====
+
+// stack_top_hint lives in main() so every frame the checks use is below it
+static void run_checks(const char *label, const void *stack_top_hint, const GCOptions *options){
+    if(!gcInitWithOptions(stack_top_hint, options)){
+        fprintf(stderr, "gcInitWithOptions failed\n");
+        exit(1);
+    }
+
+    check_stack_local();
+    check_explicit_roots();
+    check_root_range();
+    check_handles();
+    check_checkpoint();
+    check_pools();
+    check_fiber();
+    check_blacklist();
+
+    gcDestroy();
+    printf("%s: ok\n", label);
+}
+
+int main(void){
+    int stack_top_sentinel = 0;
+
+    GCOptions cache = {0};
+    run_checks("size classes (freeMemory=false)", &stack_top_sentinel, &cache);
+
+    GCOptions free_pages = {0};
+    free_pages.freeMemory = true;
+    run_checks("size classes (freeMemory=true)", &stack_top_sentinel, &free_pages);
+
+    GCOptions immix = {0};
+    immix.engine = GC_ENGINE_IMMIX;
+    run_checks("Immix (freeMemory=false)", &stack_top_sentinel, &immix);
+
+    return 0;
+}
@@ -1,3 +1,9 @@
+// ucontext.h (used by the fiber mode) is only declared for XSI builds on macOS
+#if defined(__APPLE__)
+#define _XOPEN_SOURCE 600
+#define _DARWIN_C_SOURCE
+#endif
+
 #include "../ReMem.h"
 #include "../arena/arena.h"
 
@@ -9,6 +15,7 @@
 #include <time.h>
 #include <sys/resource.h>
 #include <unistd.h>
+#include <ucontext.h>
 
 #define ROUNDS 50000
 #define SLOTS  2000
@@ -22,6 +29,8 @@ static const size_t SIZES[] = {
 #define WARMUP_FRAC_NUM 1
 #define WARMUP_FRAC_DEN 8
 
+#define FIBER_STACK_SIZE (1 << 20)
+
 typedef struct {
     uint64_t total_alloc;
     uint64_t total_freed;   // “dropped” for GC/arena modes
@@ -80,13 +89,13 @@ static inline int rnd(int n){ return rand() % n; }
 // =============
 
 // Run the test on the GC
-static void run_gc_mode(bool freeMemory, BenchStats *st){
+static void run_gc_mode(const GCOptions *options, BenchStats *st){
     void *slots[SLOTS] = {0};
     size_t sizes[SLOTS]; memset(sizes, 0, sizeof(sizes));
 
-    int stack_top_sentinel;
-    if(!gcInit(&stack_top_sentinel, freeMemory)){
-        fprintf(stderr, "gcInit failed\n");
+    int stack_top_sentinel = 0;
+    if(!gcInitWithOptions(&stack_top_sentinel, options)){
+        fprintf(stderr, "gcInitWithOptions failed\n");
         exit(1);
     }
 
@@ -136,6 +145,265 @@ static void run_gc_mode(bool freeMemory, BenchStats *st){
     gcDestroy();
 }
 
+// Run the test on the GC with one exact size pool per size instead of size classes
+static void run_gc_pool_mode(BenchStats *st){
+    void *slots[SLOTS] = {0};
+    size_t sizes[SLOTS]; memset(sizes, 0, sizeof(sizes));
+
+    int stack_top_sentinel = 0;
+    if(!gcInit(&stack_top_sentinel, false)){
+        fprintf(stderr, "gcInit failed\n");
+        exit(1);
+    }
+
+    GCPool *pools[NSIZES];
+    for(size_t i=0;i<NSIZES;i++){
+        pools[i] = gcPoolCreate(SIZES[i], 0);
+        if(!pools[i]){ fprintf(stderr, "gcPoolCreate failed\n"); exit(1); }
+    }
+
+    // warmup
+    int warm = (SLOTS*WARMUP_FRAC_NUM)/WARMUP_FRAC_DEN;
+    for(int i=0;i<warm;i++){
+        int s = rnd(NSIZES);
+        void *p = gcPoolAlloc(pools[s]);
+        touch_bytes(p, SIZES[s]);
+        slots[i] = p; sizes[i] = SIZES[s];
+        st->total_alloc += SIZES[s];
+    }
+
+    uint64_t t0 = now_ns();
+    for(int r=0;r<ROUNDS;r++){
+        for(int k=0;k<SLOTS/2;k++){
+            int idx = rnd(SLOTS);
+
+            if(slots[idx]){
+                st->total_freed += sizes[idx]; // conceptually dropped
+                slots[idx] = NULL; sizes[idx] = 0;
+            }
+
+            int s = rnd(NSIZES);
+            void *p = gcPoolAlloc(pools[s]);
+            touch_bytes(p, SIZES[s]);
+            slots[idx] = p; sizes[idx] = SIZES[s];
+            st->total_alloc += SIZES[s];
+        }
+
+        if((r % SAMPLE_EVERY)==0){
+            uint64_t rss = read_rss_kb();
+            if(rss > st->peak_rss_kb) st->peak_rss_kb = rss;
+        }
+    }
+
+    // drop all
+    for(int i=0;i<SLOTS;i++){
+        if(slots[i]){
+            st->total_freed += sizes[i];
+            slots[i] = NULL; sizes[i] = 0;
+        }
+    }
+    st->peak_rss_kb = (st->peak_rss_kb > read_rss_kb()) ? st->peak_rss_kb : read_rss_kb();
+    st->elapsed_s = (now_ns() - t0) / 1e9;
+
+    gcDestroy();
+}
+
+// Run the test on the GC with every round's allocations in a region that is released at the end of the round
+static void run_gc_region_mode(BenchStats *st){
+    int stack_top_sentinel = 0;
+    if(!gcInit(&stack_top_sentinel, false)){
+        fprintf(stderr, "gcInit failed\n");
+        exit(1);
+    }
+
+    uint64_t t0 = now_ns();
+    for(int r=0;r<ROUNDS;r++){
+        GCRegion *region = gcRegionBegin();
+        uint64_t roundBytes = 0;
+
+        for(int k=0;k<SLOTS/2;k++){
+            size_t sz = SIZES[rnd(NSIZES)];
+            void *p = gcAllocIn(region, sz);
+            touch_bytes(p, sz);
+            roundBytes += sz;
+        }
+
+        // everything from this round dies together
+        gcRegionEnd(region);
+        st->total_alloc += roundBytes;
+        st->total_freed += roundBytes;
+
+        if((r % SAMPLE_EVERY)==0){
+            uint64_t rss = read_rss_kb();
+            if(rss > st->peak_rss_kb) st->peak_rss_kb = rss;
+        }
+    }
+    st->peak_rss_kb = (st->peak_rss_kb > read_rss_kb()) ? st->peak_rss_kb : read_rss_kb();
+    st->elapsed_s = (now_ns() - t0) / 1e9;
+
+    gcDestroy();
+}
+
+// Run the test on the GC with movable objects behind handles (collections compact sparse pages)
+static void run_gc_handle_mode(BenchStats *st){
+    gc_handle_t slots[SLOTS] = {0};
+    size_t sizes[SLOTS]; memset(sizes, 0, sizeof(sizes));
+
+    int stack_top_sentinel = 0;
+    if(!gcInit(&stack_top_sentinel, false)){
+        fprintf(stderr, "gcInit failed\n");
+        exit(1);
+    }
+
+    // warmup
+    int warm = (SLOTS*WARMUP_FRAC_NUM)/WARMUP_FRAC_DEN;
+    for(int i=0;i<warm;i++){
+        size_t sz = SIZES[rnd(NSIZES)];
+        gc_handle_t h = gcAllocMovable(sz);
+        touch_bytes(gcHandleGet(h), sz);
+        slots[i] = h; sizes[i] = sz;
+        st->total_alloc += sz;
+    }
+
+    uint64_t t0 = now_ns();
+    for(int r=0;r<ROUNDS;r++){
+        for(int k=0;k<SLOTS/2;k++){
+            int idx = rnd(SLOTS);
+
+            if(slots[idx]){
+                st->total_freed += sizes[idx];
+                gcReleaseHandle(slots[idx]);
+                slots[idx] = 0; sizes[idx] = 0;
+            }
+
+            size_t sz = SIZES[rnd(NSIZES)];
+            gc_handle_t h = gcAllocMovable(sz);
+            touch_bytes(gcHandleGet(h), sz);
+            slots[idx] = h; sizes[idx] = sz;
+            st->total_alloc += sz;
+        }
+
+        if((r % SAMPLE_EVERY)==0){
+            uint64_t rss = read_rss_kb();
+            if(rss > st->peak_rss_kb) st->peak_rss_kb = rss;
+        }
+    }
+
+    // drop all
+    for(int i=0;i<SLOTS;i++){
+        if(slots[i]){
+            st->total_freed += sizes[i];
+            gcReleaseHandle(slots[i]);
+            slots[i] = 0; sizes[i] = 0;
+        }
+    }
+    st->peak_rss_kb = (st->peak_rss_kb > read_rss_kb()) ? st->peak_rss_kb : read_rss_kb();
+    st->elapsed_s = (now_ns() - t0) / 1e9;
+
+    gcDestroy();
+}
+
+// state shared between the main stack and the fiber in the fiber mode
+static ucontext_t fiber_main_ctx, fiber_ctx;
+static GCStack *fiber_stack;
+static BenchStats *fiber_stats;
+static bool fiber_done;
+
+// suspends the fiber and goes back to the main stack
+static void fiber_yield(void){
+    gcSwitchStack(NULL);
+    swapcontext(&fiber_ctx, &fiber_main_ctx);
+}
+
+// the workload run on the fiber, its slots only live on the fiber's stack
+static void fiber_entry(void){
+    void *slots[SLOTS] = {0};
+    size_t sizes[SLOTS]; memset(sizes, 0, sizeof(sizes));
+    BenchStats *st = fiber_stats;
+
+    // warmup
+    int warm = (SLOTS*WARMUP_FRAC_NUM)/WARMUP_FRAC_DEN;
+    for(int i=0;i<warm;i++){
+        size_t sz = SIZES[rnd(NSIZES)];
+        void *p = gcAlloc(sz);
+        touch_bytes(p, sz);
+        slots[i] = p; sizes[i] = sz;
+        st->total_alloc += sz;
+    }
+
+    for(int r=0;r<ROUNDS;r++){
+        for(int k=0;k<SLOTS/2;k++){
+            int idx = rnd(SLOTS);
+
+            if(slots[idx]){
+                st->total_freed += sizes[idx]; // conceptually dropped
+                slots[idx] = NULL; sizes[idx] = 0;
+            }
+
+            size_t sz = SIZES[rnd(NSIZES)];
+            void *p = gcAlloc(sz);
+            touch_bytes(p, sz);
+            slots[idx] = p; sizes[idx] = sz;
+            st->total_alloc += sz;
+        }
+
+        // let the main stack run (and collect) while this stack is suspended
+        if((r % SAMPLE_EVERY)==0) fiber_yield();
+    }
+
+    // drop all
+    for(int i=0;i<SLOTS;i++){
+        if(slots[i]){
+            st->total_freed += sizes[i];
+            slots[i] = NULL; sizes[i] = 0;
+        }
+    }
+
+    fiber_done = true;
+    fiber_yield();
+}
+
+// Run the test on the GC from a fiber stack registered with the GC, switching back to the main stack every SAMPLE_EVERY rounds
+static void run_gc_fiber_mode(BenchStats *st){
+    int stack_top_sentinel = 0;
+    if(!gcInit(&stack_top_sentinel, false)){
+        fprintf(stderr, "gcInit failed\n");
+        exit(1);
+    }
+
+    char *fiber_mem = malloc(FIBER_STACK_SIZE);
+    if(!fiber_mem){ perror("malloc"); exit(1); }
+
+    getcontext(&fiber_ctx);
+    fiber_ctx.uc_stack.ss_sp = fiber_mem;
+    fiber_ctx.uc_stack.ss_size = FIBER_STACK_SIZE;
+    fiber_ctx.uc_link = &fiber_main_ctx;
+    makecontext(&fiber_ctx, fiber_entry, 0);
+
+    fiber_stack = gcRegisterStack(fiber_mem, fiber_mem + FIBER_STACK_SIZE, &fiber_ctx, sizeof(fiber_ctx));
+    if(!fiber_stack){ fprintf(stderr, "gcRegisterStack failed\n"); exit(1); }
+    fiber_stats = st;
+    fiber_done = false;
+
+    uint64_t t0 = now_ns();
+    while(!fiber_done){
+        gcSwitchStack(fiber_stack);
+        swapcontext(&fiber_main_ctx, &fiber_ctx);
+
+        // collect while the fiber is suspended so only its saved stack keeps its slots alive
+        gcCollect();
+
+        uint64_t rss = read_rss_kb();
+        if(rss > st->peak_rss_kb) st->peak_rss_kb = rss;
+    }
+    st->peak_rss_kb = (st->peak_rss_kb > read_rss_kb()) ? st->peak_rss_kb : read_rss_kb();
+    st->elapsed_s = (now_ns() - t0) / 1e9;
+
+    gcUnregisterStack(fiber_stack);
+    gcDestroy();
+    free(fiber_mem);
+}
+
 // run the test using only malloc and free
 static void run_malloc_mode(BenchStats *st){
     void *slots[SLOTS] = {0};
@@ -261,21 +529,54 @@ static void print_stats(const char *label, const BenchStats *st){
 int main(void){
     srand(0xC0FFEE);
 
-    BenchStats st_gc_free = {0}, st_gc_cache = {0}, st_malloc = {0}, st_arena = {0};
+    BenchStats st_gc_free = {0}, st_gc_cache = {0}, st_immix_free = {0}, st_immix_cache = {0};
+    BenchStats st_pool = {0}, st_region = {0}, st_handle = {0}, st_fiber = {0}, st_malloc = {0}, st_arena = {0};
 
     // 1) ReMem GC, free pages back to OS
-    run_gc_mode(true, &st_gc_free);
+    GCOptions gc_free = {0};
+    gc_free.freeMemory = true;
+    run_gc_mode(&gc_free, &st_gc_free);
     print_stats("ReMem GC (freeMemory=true)", &st_gc_free);
 
     // 2) ReMem GC, cache pages for reuse
-    run_gc_mode(false, &st_gc_cache);
+    GCOptions gc_cache = {0};
+    run_gc_mode(&gc_cache, &st_gc_cache);
     print_stats("ReMem GC (freeMemory=false)", &st_gc_cache);
 
-    // 3) malloc/free
+    // 3) ReMem GC on the Immix engine, free pages back to OS
+    GCOptions immix_free = {0};
+    immix_free.freeMemory = true;
+    immix_free.engine = GC_ENGINE_IMMIX;
+    run_gc_mode(&immix_free, &st_immix_free);
+    print_stats("ReMem GC Immix (freeMemory=true)", &st_immix_free);
+
+    // 4) ReMem GC on the Immix engine, cache pages for reuse
+    GCOptions immix_cache = {0};
+    immix_cache.engine = GC_ENGINE_IMMIX;
+    run_gc_mode(&immix_cache, &st_immix_cache);
+    print_stats("ReMem GC Immix (freeMemory=false)", &st_immix_cache);
+
+    // 5) ReMem GC, exact size pools
+    run_gc_pool_mode(&st_pool);
+    print_stats("ReMem GC pools (gcPoolAlloc)", &st_pool);
+
+    // 6) ReMem GC, one region per round
+    run_gc_region_mode(&st_region);
+    print_stats("ReMem GC regions (gcAllocIn)", &st_region);
+
+    // 7) ReMem GC, movable objects behind handles
+    run_gc_handle_mode(&st_handle);
+    print_stats("ReMem GC handles (gcAllocMovable)", &st_handle);
+
+    // 8) ReMem GC, workload on a registered fiber stack
+    run_gc_fiber_mode(&st_fiber);
+    print_stats("ReMem GC fiber (gcRegisterStack)", &st_fiber);
+
+    // 9) malloc/free
     run_malloc_mode(&st_malloc);
     print_stats("malloc/free", &st_malloc);
 
-    // 4) arena-only (no frees until end)
+    // 10) arena-only (no frees until end)
     run_arena_only_mode(&st_arena);
     print_stats("arena-only (arenaAlloc)", &st_arena);
 